@@ -19,6 +19,14 @@ else
 CFLAGS += -O3
 endif
 
+# Optional instrumentation, eg. make PROFILE=HEAP or PROFILE="HEAP LOCK"
+ifneq ($(filter HEAP,$(PROFILE)),)
+CFLAGS += -DHELIUM_PROFILE_HEAP
+endif
+ifneq ($(filter LOCK,$(PROFILE)),)
+CFLAGS += -DHELIUM_PROFILE_LOCK
+endif
+
 CLEAN += $(INITRD_SYSROOT)sys/
 
 # Compile targets
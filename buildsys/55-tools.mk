@@ -9,4 +9,12 @@ $(UPCONFIG_BIN): $(UPCONFIG_DIR)/Cargo.toml $(wildcard $(UPCONFIG_DIR)/src/*.rs)
 CLEAN += $(UPCONFIG_BIN)
 
 .PHONY: tool-upconfig
-tool-upconfig: $(UPCONFIG_BIN)
\ No newline at end of file
+tool-upconfig: $(UPCONFIG_BIN)
+
+RINGTEST_DIR := $(TOOLS_DIR)ringtest/
+
+# Host stress test and throughput run of the kernel rings, not part of the
+# image
+.PHONY: tool-ringtest
+tool-ringtest:
+	$(MAKE) -C $(RINGTEST_DIR) CC=$(BUILD_CC) run
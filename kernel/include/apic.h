@@ -148,10 +148,25 @@ typedef struct IOAPIC_INFO {
 
 #define TIMER_DIVCFG(mode) ((mode & 0b11) | ((mode & 0b100) << 1))
 
+#define APIC_TIMER_PERIODIC (0b01)
+#define APIC_TIMER_ONESHOT (0b00)
+
+#define APIC_TIMER_VECTOR (0xF0)
+// Only wakes the processor up, sent to idle processors with work to pick up
+#define APIC_KICK_VECTOR (0xF1)
+// Runs the cross processor calls queued to the processor, see smp.h
+#define APIC_CALL_VECTOR (0xF2)
+
 void     apic_init();
 uint32_t apic_getid();
 void     apic_eoi();
 
+// Timer counts are bus clocks, the timer interrupt is APIC_TIMER_VECTOR. A
+// one shot count of 0 stops the timer
+void     apic_timer_set(uint32_t mode, uint32_t count);
+uint32_t apic_timer_count();
+void apic_send_ipi(uint32_t apic_id, uint8_t vector);
+
 size_t ioapic_find_redirection(size_t irq);
 void   ioapic_set_handler(size_t irq, size_t vector);
 
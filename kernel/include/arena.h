@@ -0,0 +1,45 @@
+#ifndef HELIUM_ARENA_H
+#define HELIUM_ARENA_H
+
+#include <stddef.h>
+
+/*
+  Bump allocator for memory that is all released at once, boot time
+  structures that live forever, or the scratch memory of a single request.
+  Memory is handed out from large chunks taken from the kernel heap, there
+  is no way to free a single allocation. An arena is not thread safe, it
+  should only be used by one context at a time.
+*/
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_ALIGNMENT (16)
+
+// Padded, so that the memory right after it is aligned too
+struct ARENA_CHUNK;
+typedef struct ARENA_CHUNK arena_chunk;
+struct ARENA_CHUNK {
+  arena_chunk *next;
+  size_t       size;  // Bytes that can be handed out, header not counted
+  size_t       used;
+} __attribute__((aligned(ARENA_ALIGNMENT)));
+
+struct ARENA;
+typedef struct ARENA arena;
+struct ARENA {
+  arena_chunk *chunks;  // The chunk being used is always the first
+  size_t       chunk_size;
+};
+
+// chunk_size 0 => ARENA_CHUNK_SIZE, it counts the chunk header and has to
+// be larger than it
+arena *arena_create(size_t chunk_size);
+void   arena_destroy(arena *arena);
+
+// Returns memory aligned to ARENA_ALIGNMENT, not zeroed
+void *arena_alloc(arena *arena, size_t size);
+char *arena_strdup(arena *arena, char const *str);
+
+// Releases everything allocated from the arena, only its first chunk is kept
+void arena_reset(arena *arena);
+
+#endif
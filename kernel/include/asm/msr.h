@@ -4,12 +4,16 @@
 #include <stdint.h>
 
 #define MSR_IA32_APIC_BASE (0x1B)
+#define MSR_IA32_TSC_ADJUST (0x3B)
 
 #define MSR_IA32_EFER (0xC0000080)
 #define MSR_IA32_STAR (0xC0000081)
 #define MSR_IA32_LSTAR (0xC0000082)
 #define MSR_IA32_CSTAR (0xC0000083)
 #define MSR_IA32_SFMASK (0xC0000084)
+#define MSR_IA32_GS_BASE (0xC0000101)
+#define MSR_IA32_KERNEL_GS_BASE (0xC0000102)
+#define MSR_IA32_TSC_AUX (0xC0000103)
 
 uint64_t as_smsr(uint32_t regn);
 void     as_lmsr(uint32_t regn, uint64_t val);
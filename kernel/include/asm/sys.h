@@ -4,7 +4,6 @@
 #include <attributes.h>
 
 noreturn void as_sys_stop();
-noreturn void as_event_loop();
 
 // No call
 void as_syscall_handle();
@@ -0,0 +1,18 @@
+#ifndef HELIUM_ASM_TASK_H
+#define HELIUM_ASM_TASK_H
+
+#include <task.h>
+
+// rbp, rbx and r12 to r15, pushed by as_task_switch
+#define AS_TASK_SAVED_REGS (6)
+
+// Saves the callee saved registers and the stack pointer in *save_sp, and
+// resumes the task whose stack pointer is load_sp. Returns, on the resumed
+// task's stack, the prev argument of the switch that resumed it
+task *as_task_switch(void **save_sp, void *load_sp, task *prev);
+
+// No call, first return of a new task, passes the previous task to
+// sched_task_start
+void as_task_start();
+
+#endif
@@ -12,6 +12,10 @@
 
 #define unused [[maybe_unused]]
 
+#define CACHE_LINE_SIZE (64)
+// Aligns a struct or variable on its own cache line(s)
+#define cache_aligned __attribute__((aligned(CACHE_LINE_SIZE)))
+
 #define AS_STRING_IMPL(x) #x
 #define AS_STRING(x) AS_STRING_IMPL(x)
 
@@ -3,7 +3,7 @@
 
 #include <acpi.h>
 
-#include <dts/hashtable.h>
+#include <dts/chashtable.h>
 
 typedef void (*cfgtb_acpi_handler)(acpi_header *table);
 
@@ -0,0 +1,55 @@
+#ifndef HELIUM_CLOCK_H
+#define HELIUM_CLOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  Two clocks. The tick clock counts the BSP's APIC timer ticks, it drives
+  timer deadlines. ktime_ns reads the TSC, calibrated at boot against the
+  frequency CPUID reports, or the PIT, and takes no lock: its parameters
+  never change once the processors are synchronized at boot.
+  The TSCs of the other processors are synchronized with the BSP's when
+  they start, through IA32_TSC_ADJUST when they have it, otherwise their
+  offset is kept and added back on every read, with the processor found
+  through rdtscp.
+*/
+
+// The APIC timer of the BSP drives the tick clock, it fires every
+// millisecond
+#define CLOCK_TICK_NS (1000 * 1000)
+
+// Length of one PIT calibration run, and how many are made, the shortest
+// one wins, the others were likely interrupted by SMIs or the hypervisor
+#define CLOCK_CALIBRATE_MS (10)
+#define CLOCK_CALIBRATE_RUNS (3)
+// Fastest TSC expected, in MHz, a run waits for the PIT at most 4 times as
+// long as the run would take at this rate
+#define CLOCK_CALIBRATE_MAX_MHZ (10000)
+
+// Round trips measured with the BSP to synchronize a TSC
+#define CLOCK_SYNC_ROUNDS (8)
+
+// Calibrates the TSC, on the BSP, before the other processors start
+void clock_init();
+
+// Synchronizes the TSC of the calling processor with the BSP's, before it
+// reads the clock, the BSP answers with clock_sync_serve until aps
+// processors are done
+void clock_sync();
+void clock_sync_serve(size_t aps);
+
+uint64_t clock_tsc_hz();
+// Nanoseconds since clock_init
+uint64_t ktime_ns();
+
+// Advances the clock by a tick, only the BSP timer interrupt calls it
+void clock_tick();
+
+// Reads the number of ticks since the clock started, and the TSC of the
+// processor that counted the last one, both from the same tick
+void clock_read(uint64_t *ticks, uint64_t *tsc);
+
+uint64_t clock_uptime_ns();
+
+#endif
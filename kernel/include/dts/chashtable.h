@@ -0,0 +1,126 @@
+#ifndef HELIUM_DTS_CHASHTABLE_H
+#define HELIUM_DTS_CHASHTABLE_H
+
+#ifndef DTS_CHASHTABLE_MAX_LOAD
+#define DTS_CHASHTABLE_MAX_LOAD (2)
+#endif
+
+#ifndef DTS_CHASHTABLE_INIT_BUCKETS
+#define DTS_CHASHTABLE_INIT_BUCKETS (32)
+#endif
+
+// Buckets moved to the new table by every insertion or removal while the
+// table is being resized
+#ifndef DTS_CHASHTABLE_MIGRATE
+#define DTS_CHASHTABLE_MIGRATE (4)
+#endif
+
+#include <lock.h>
+#include <rcu.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <dts/hashtable.h>
+
+/*
+  Concurrent hashtable, with the same interface as dts_hashtable. Searching
+  takes no lock and writes nothing, it runs under RCU, writers lock the
+  buckets they change. Once there are more than max_load entries per bucket
+  on average, a table twice as big is published next to the current one, and
+  every following insertion or removal moves a few buckets to it, nothing
+  ever waits for the whole table to be moved. Searches look in both tables
+  until it is done.
+  Removed entries are freed after a grace period, so an object returned by
+  dts_chashtable_search stays valid until the next quiescent state of the
+  caller, unless it is removed by the caller itself.
+  Keys are expected to be unique, dts_chashtable_insert does not check.
+  Writers may run with interrupts disabled, not in interrupt handlers.
+*/
+
+typedef struct DTS_CHASHTABLE        dts_chashtable;
+typedef struct DTS_CHASHTABLE_NODE   dts_chashtable_node;
+typedef struct DTS_CHASHTABLE_BUCKET dts_chashtable_bucket;
+typedef struct DTS_CHASHTABLE_TABLE  dts_chashtable_table;
+typedef struct DTS_CHASHTABLE_STATE  dts_chashtable_state;
+
+typedef void (*dts_chashtable_destroy_pair_f)(
+    dts_chashtable *ht, void const *k, void *obj
+);
+
+struct DTS_CHASHTABLE_NODE {
+  dts_chashtable_node *next;
+  void                *key;
+  void                *obj;
+  size_t               objsize;
+
+  // The key and object are copies to free along with the node, only one
+  // node owns them once they are moved to a new table
+  bool     own_key;
+  bool     own_obj;
+  rcu_head rcu;
+};
+
+struct DTS_CHASHTABLE_BUCKET {
+  spinlock             lock;
+  dts_chashtable_node *head;
+};
+
+struct DTS_CHASHTABLE_TABLE {
+  size_t                nbuckets;
+  dts_chashtable_bucket buckets[];
+};
+
+// Replaced as a whole when a resize starts or ends, so readers always see
+// a table and the one it is being moved to together
+struct DTS_CHASHTABLE_STATE {
+  dts_chashtable_table *cur;
+  dts_chashtable_table *old;  // Being moved to cur, or null
+
+  rcu_head rcu;
+};
+
+struct DTS_CHASHTABLE {
+  dts_chashtable_state *state;
+
+  spinlock        resize_lock;  // Serializes state changes and migrated
+  size_t          migrated;     // Buckets of old already moved
+  volatile size_t count;
+
+  size_t max_load;
+  size_t objsize;
+
+  dts_keycmp_f keycmp;
+  dts_hash_f   hash;
+  dts_keylen_f keylen;
+};
+
+dts_chashtable *dts_chashtable_create_strkey(size_t esize);
+dts_chashtable *dts_chashtable_create_uptrkey(size_t esize);
+dts_chashtable *dts_chashtable_create(
+    size_t       esize,  // esize 0 => no allocation for object, pointer is data
+    size_t       max_load,
+    size_t       init_nbuckets,
+    dts_keycmp_f keycmp,
+    dts_keylen_f
+               keylen,  // Keylen NULL => no allocation for key, pointer is key
+    dts_hash_f hash
+);
+
+// Nothing may use the table anymore, readers included
+void dts_chashtable_destroy(
+    dts_chashtable *ht, dts_chashtable_destroy_pair_f destroy_pair
+);
+
+void *dts_chashtable_insert(
+    dts_chashtable *ht, void const *key, void const *obj
+);
+void *dts_chashtable_insert_extra(
+    dts_chashtable *ht, void const *key, void const *obj, size_t objsize
+);
+void *dts_chashtable_search(dts_chashtable *ht, void const *key, bool *found);
+// Copies the object to out_obj if it is not null, tables that do not own
+// their objects store the object pointer there instead
+void dts_chashtable_remove(dts_chashtable *ht, void const *key, void *out_obj);
+
+#endif
@@ -35,6 +35,7 @@ struct DTS_HASHTABLE_NODE {
 struct DTS_HASHTABLE {
   size_t               nbuckets;
   dts_hashtable_node **buckets;
+  size_t               count;
 
   size_t max_collisions;
   size_t objsize;
@@ -65,6 +66,8 @@ void *dts_hashtable_insert_extra(
     dts_hashtable *ht, void const *key, void const *obj, size_t objsize
 );
 void *dts_hashtable_search(dts_hashtable *ht, void const *key, bool *found);
+// Copies the object to out_obj if it is not null, tables that do not own
+// their objects store the object pointer there instead
 void  dts_hashtable_remove(dts_hashtable *ht, void const *key, void *out_obj);
 
 size_t dts_hashtable_std_strhash(void const *key);
@@ -0,0 +1,68 @@
+#ifndef HELIUM_DTS_RING_H
+#define HELIUM_DTS_RING_H
+
+#include <attributes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+  Bounded lock-free rings of fixed size elements. The memory is allocated
+  once by the create function, pushing and popping never allocate, never
+  lock and never wait, a full ring refuses the push, an empty one the pop.
+  The capacity is rounded up to a power of two.
+
+  dts_ring is safe with any number of producers and consumers, every slot
+  carries a sequence number telling whether it is ready to be written or
+  read in the current lap, so producers only fight over the head index and
+  consumers over the tail index, on separate cache lines. When there is
+  only one consumer, it pops with dts_ring_pop_single, which does not need
+  to compare and swap the tail, the ring must then never be popped with
+  dts_ring_pop.
+
+  dts_spsc_ring is for exactly one producer and one consumer, each side
+  keeps a copy of the other side's index on its own line and only reads the
+  shared one when its copy says the ring is full, or empty.
+
+  tools/ringtest checks the ordering of all three on the host, with
+  pthreads, and measures their throughput, make tool-ringtest.
+*/
+
+typedef struct DTS_RING      dts_ring;
+typedef struct DTS_SPSC_RING dts_spsc_ring;
+
+struct DTS_RING {
+  volatile size_t head cache_aligned;  // Next position to push
+  volatile size_t tail cache_aligned;  // Next position to pop
+
+  size_t mask cache_aligned;
+  size_t elen;
+  size_t stride;  // Bytes per slot, sequence number and element
+  void  *slots;
+};
+
+struct DTS_SPSC_RING {
+  volatile size_t head cache_aligned;  // Written by the producer only
+  size_t          tail_cache;          // Producer's copy of tail
+
+  volatile size_t tail cache_aligned;  // Written by the consumer only
+  size_t          head_cache;          // Consumer's copy of head
+
+  size_t mask cache_aligned;
+  size_t elen;
+  void  *elements;
+};
+
+dts_ring *dts_ring_create(size_t elen, size_t cap);
+void      dts_ring_destroy(dts_ring *ring);
+
+bool dts_ring_push(dts_ring *ring, void const *element);
+bool dts_ring_pop(dts_ring *ring, void *out_element);
+bool dts_ring_pop_single(dts_ring *ring, void *out_element);
+
+dts_spsc_ring *dts_spsc_ring_create(size_t elen, size_t cap);
+void           dts_spsc_ring_destroy(dts_spsc_ring *ring);
+
+bool dts_spsc_ring_push(dts_spsc_ring *ring, void const *element);
+bool dts_spsc_ring_pop(dts_spsc_ring *ring, void *out_element);
+
+#endif
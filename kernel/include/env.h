@@ -6,6 +6,14 @@
 
 // Not 100% accurate, works with Qemu
 bool     env_isvm();
+bool     env_hasmwait();
 uint32_t env_busfreq();
 
+// The TSC ticks at a constant rate, in every power state
+bool     env_hasinvtsc();
+bool     env_hasrdtscp();
+bool     env_hastscadjust();
+// TSC frequency in Hz as reported by CPUID, 0 if it is not
+uint64_t env_tschz();
+
 #endif
\ No newline at end of file
@@ -74,4 +74,35 @@ void int_load();
 #define int_enable() asm("sti")
 #define int_disable() asm("cli")
 
+// Disables interrupts, returns the previous RFLAGS to pass to int_restore()
+#define int_save()                                                             \
+  ({                                                                           \
+    uint64_t __rflags;                                                         \
+    asm volatile("pushfq\n\tpop %0\n\tcli" : "=r"(__rflags)::"memory");        \
+    __rflags;                                                                  \
+  })
+// Checks if interrupts are enabled on the calling processor
+#define int_enabled()                                                          \
+  ({                                                                           \
+    uint64_t __rflags;                                                         \
+    asm volatile("pushfq\n\tpop %0" : "=r"(__rflags)::"memory");               \
+    (__rflags & (1 << 9)) != 0;                                                \
+  })
+// Re-enables interrupts only if they were enabled when int_save() was called
+#define int_restore(rflags)                                                    \
+  do {                                                                         \
+    if ((rflags) & (1 << 9)) {                                                 \
+      asm volatile("sti" ::: "memory");                                        \
+    }                                                                          \
+  } while (0)
+
+// Handlers that use per processor data swap the kernel GS base in first
+// when they interrupt user mode, and back out last, see proc.h
+#define int_swapgs(frame)                                                      \
+  do {                                                                         \
+    if ((frame)->cs & 3) {                                                     \
+      asm volatile("swapgs" ::: "memory");                                     \
+    }                                                                          \
+  } while (0)
+
 #endif
\ No newline at end of file
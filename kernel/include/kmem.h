@@ -0,0 +1,76 @@
+#ifndef HELIUM_KMEM_H
+#define HELIUM_KMEM_H
+
+#include <attributes.h>
+#include <lock.h>
+#include <proc.h>
+#include <stddef.h>
+
+/*
+  Object caches for fixed size kernel objects. Objects are carved from
+  KMEM_SLAB_SIZE aligned slabs in the KSLAB virtual range, the slab header
+  is found by aligning an object pointer down, so objects carry no header.
+  Every processor has its own magazine of free objects, the slab lists are
+  only touched when a magazine runs empty or full.
+*/
+
+#define KMEM_SLAB_SIZE (16 * 1024)
+#define KMEM_MAX_OBJSIZE (KMEM_SLAB_SIZE / 8)
+
+#define KMEM_MAGAZINE_LEN (15)
+
+typedef void (*kmem_ctor_f)(void *obj);
+
+struct KMEM_SLAB;
+typedef struct KMEM_SLAB kmem_slab;
+
+struct KMEM_MAGAZINE;
+typedef struct KMEM_MAGAZINE kmem_magazine;
+struct KMEM_MAGAZINE {
+  size_t len;
+  void  *objs[KMEM_MAGAZINE_LEN];
+} cache_aligned;
+
+struct KMEM_CACHE;
+typedef struct KMEM_CACHE kmem_cache;
+struct KMEM_CACHE {
+  char const *name;
+
+  size_t      objsize;   // Aligned, distance between two objects
+  size_t      objoff;    // Offset of the first object from the slab start
+  size_t      linkoff;   // Offset of the free list link in a free object
+  size_t      slab_len;  // Number of objects in a slab
+  kmem_ctor_f ctor;
+
+  spinlock   lock;     // Protects everything below, taken with interrupts off
+  kmem_slab *partial;  // Slabs that have at least one free object
+  size_t     slab_count;
+
+  kmem_magazine magazines[PROC_MAX_COUNT];
+};
+
+struct KMEM_SLAB {
+  kmem_cache *cache;
+  kmem_slab  *next;
+  kmem_slab  *prev;
+  void       *freelist;
+  size_t      inuse;
+};
+
+/*
+  Creates a cache of objects of `size` bytes, aligned to at least `align`
+  and to a cache line. `ctor`, if not null, is called once on each object
+  when its slab is created, freed objects are expected to be given back in
+  their constructed state. The free list link of such caches is kept past
+  the object, the constructed state is never written over.
+*/
+kmem_cache *kmem_cache_create(
+    char const *name, size_t size, size_t align, kmem_ctor_f ctor
+);
+void *kmem_cache_alloc(kmem_cache *cache);
+void  kmem_cache_free(kmem_cache *cache, void *obj);
+
+// Debug
+void kmem_cache_print_state(kmem_cache *cache);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef HELIUM_KTHREAD_H
+#define HELIUM_KTHREAD_H
+
+#include <attributes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <task.h>
+#include <wait.h>
+
+/*
+  Kernel threads, tasks that run a kernel function and never go to user
+  mode. A thread ends by returning from its function, or with kthread_exit,
+  and its result is handed to kthread_join. The thread handle is freed once
+  it is joined, or detached, and the thread exited, whichever comes last,
+  so every thread must be joined or detached exactly once.
+  Threads are scheduled like any other task, kernel code is not preempted,
+  long running threads should call sched_cond_yield now and then.
+*/
+
+// Switches timed by kthread_bench, per thread
+#define KTHREAD_BENCH_ROUNDS (100000)
+
+typedef void *(*kthread_f)(void *arg);
+
+struct KTHREAD;
+typedef struct KTHREAD kthread;
+struct KTHREAD {
+  task     *task;
+  kthread_f fn;
+  void     *arg;
+  void     *ret;
+
+  volatile bool     exited;
+  wait_queue        exit_wait;
+  volatile uint32_t refs;  // Held by the thread, and until joined or detached
+};
+
+// Both return 0 if out of memory, the thread starts right away
+kthread *kthread_create(kthread_f fn, void *arg);
+// The thread only ever runs on the processor with the given sysid
+kthread *kthread_create_on(kthread_f fn, void *arg, size_t sysid);
+
+// Only from the thread itself
+noreturn void kthread_exit(void *ret);
+// Waits for the thread to end, returns its result
+void *kthread_join(kthread *kt);
+void  kthread_detach(kthread *kt);
+
+// Times switches between two threads pinned on the calling processor,
+// printed on the debug console
+void kthread_bench();
+
+#endif
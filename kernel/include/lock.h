@@ -0,0 +1,144 @@
+#ifndef HELIUM_LOCK_H
+#define HELIUM_LOCK_H
+
+#include <attributes.h>
+#include <proc.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys.h>
+
+/*
+  Fair spinning locks. Both are handed to waiters in the order they arrived.
+  A ticket lock is a pair of counters, it is the smallest and fastest when
+  the lock is rarely fought over, but every waiter spins on the same line.
+  An MCS lock queues its waiters, each spinning on its own node, so a
+  release only touches the line of the next waiter, which is what heavily
+  contended locks want. The node is provided by the caller, usually on its
+  stack, and has to stay alive until the lock is released.
+  The _irqsave variants disable interrupts before taking the lock and return
+  the previous RFLAGS to pass to the _irqrestore variants, locks that are
+  also taken by interrupt handlers should only ever be taken that way.
+  Zero initialized locks are unlocked.
+*/
+
+struct SPINLOCK;
+typedef struct SPINLOCK spinlock;
+struct SPINLOCK {
+  volatile uint32_t next;   // Ticket of the next processor to arrive
+  volatile uint32_t owner;  // Ticket of the processor holding the lock
+};
+
+struct MCS_NODE;
+typedef struct MCS_NODE mcs_node;
+struct MCS_NODE {
+  mcs_node *volatile next;
+  volatile bool      locked;
+} cache_aligned;
+
+struct MCS_LOCK;
+typedef struct MCS_LOCK mcs_lock;
+struct MCS_LOCK {
+  mcs_node *volatile tail;  // Last waiter, or holder, 0 if unlocked
+};
+
+void spin_lock(spinlock *lock);
+bool spin_trylock(spinlock *lock);
+void spin_unlock(spinlock *lock);
+
+uint64_t spin_lock_irqsave(spinlock *lock);
+void     spin_unlock_irqrestore(spinlock *lock, uint64_t rflags);
+
+void mcs_acquire(mcs_lock *lock, mcs_node *node);
+void mcs_release(mcs_lock *lock, mcs_node *node);
+
+uint64_t mcs_acquire_irqsave(mcs_lock *lock, mcs_node *node);
+
+void mcs_release_irqrestore(mcs_lock *lock, mcs_node *node, uint64_t rflags);
+
+/*
+  Reader-writer lock for read-mostly data. Every processor counts its
+  readers on a cache line of its own, so readers on different processors
+  never write the same line, and only the writer looks at all of them.
+  A writer raises its flag and waits for every count to drop to zero, new
+  readers back off while the flag is up, so writers are not starved.
+  rw_read_lock returns the slot the reader was counted in, to give back to
+  rw_read_unlock, the reader may be on another processor by then.
+  Readers may nest, on the processor they took the lock on or in an
+  interrupt of it: a reader finding its slot already counted goes in even
+  while a writer waits, the writer cannot get past that slot anyway. A
+  writer may not take the lock for reading.
+*/
+
+struct RWLOCK_READERS;
+typedef struct RWLOCK_READERS rwlock_readers;
+struct RWLOCK_READERS {
+  volatile uint32_t count;
+} cache_aligned;
+
+struct RWLOCK;
+typedef struct RWLOCK rwlock;
+struct RWLOCK {
+  spinlock      writer;  // Serializes writers
+  volatile bool writing;
+
+  rwlock_readers readers[PROC_MAX_COUNT];
+};
+
+size_t rw_read_lock(rwlock *lock);
+void   rw_read_unlock(rwlock *lock, size_t slot);
+
+void rw_write_lock(rwlock *lock);
+void rw_write_unlock(rwlock *lock);
+
+uint64_t rw_write_lock_irqsave(rwlock *lock);
+void     rw_write_unlock_irqrestore(rwlock *lock, uint64_t rflags);
+
+/*
+  Sequence lock for small records of plain values that are read far more
+  often than written, like the clock. Readers do not write anything, they
+  copy the record between seq_read_begin and seq_read_retry, and start over
+  if a writer was there in the meantime. Writers are serialized and run with
+  interrupts disabled, so a reader never waits on a writer it interrupted.
+*/
+
+struct SEQLOCK;
+typedef struct SEQLOCK seqlock;
+struct SEQLOCK {
+  volatile uint32_t seq;  // Odd while a writer is in
+  spinlock          writer;
+};
+
+uint32_t seq_read_begin(seqlock *lock);
+bool     seq_read_retry(seqlock *lock, uint32_t start);
+
+uint64_t seq_write_lock(seqlock *lock);
+void     seq_write_unlock(seqlock *lock, uint64_t rflags);
+
+/*
+  Lock profiler, built in with make PROFILE=LOCK. Every spinlock, MCS lock,
+  and the writer side of reader-writer and sequence locks, counts how often
+  it was taken, how often it had to wait, and the cycles it waited for, in
+  total and at most. The call sites that waited the most are kept for each
+  lock. Readers are not counted, they only ever wait on writers.
+  Locks are told apart by their address, which the symbol table resolves
+  for static locks, others can be given a name with lock_stat_name.
+  lock_stat_dump prints the locks that waited the longest first.
+*/
+
+#ifdef HELIUM_PROFILE_LOCK
+// Called with the lock held, spin_cycles is 0 if it was not waited for
+void lock_stat_acquired(void const *lock, uint64_t spin_cycles, void *site);
+void lock_stat_name(void const *lock, char const *name);
+#define lock_stat_clock() rdtsc()
+#else
+#define lock_stat_acquired(lock, spin_cycles, site) \
+  ((void)(lock), (void)(spin_cycles), (void)(site))
+#define lock_stat_name(lock, name)
+#define lock_stat_clock() ((uint64_t)0)
+#endif
+
+void lock_stat_dump();
+void lock_stat_reset();
+
+#endif
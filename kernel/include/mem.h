@@ -53,6 +53,9 @@ mem_pallocation mem_ppalloc(
     void *pheader, size_t size, size_t alignement, bool cont, void *below
 );
 void mem_ppfree(void *pheader, mem_pallocation alloc);
+// Frees physical pages knowing only their address, they should all be in the
+// same physical segment
+void mem_ppfree_padr(void *pheader, void *padr, size_t size);
 
 /* mem_v* */
 // ERR_MEM memory operations errors
@@ -67,8 +70,14 @@ void mem_ppfree(void *pheader, mem_pallocation alloc);
                                     another kernel system(eg; vcache) */
 #define ERR_MEM_NO_VC_SPACE (-6) /* Couldn't allocate a VCache page */
 
+// Safe to call from any processor, mappings are serialized
 errno_t mem_vmap(void *vadr, void *padr, size_t size, int flags);
 errno_t mem_vumap(void *vadr, size_t size);
+/*
+  Moves the pages mapped in [src, src+size) to [dst, dst+size), without
+  copying them, unmapped pages in src are left unmapped in dst
+*/
+errno_t mem_vmove(void *dst, void *src, size_t size, int flags);
 
 #define MEM_VSEG_ERROR_INVALID (-1)
 #define MEM_VSEG_ERROR_NMEM (-2)
@@ -93,7 +102,16 @@ mem_vseg mem_find_vsegment(size_t size, void *heap_start, size_t heap_size);
 mem_vseg mem_alloc_vblock(
     size_t size, int flags, void *heap_start, size_t heap_size
 );
+/*
+  Maps new physical pages at [vptr, vptr+size), returns vptr, or 0 with
+  nothing left mapped if memory runs out
+*/
 void *mem_alloc_into(void *vptr, size_t size, int flags);
+/*
+  Unmaps a block of virtual memory and frees the physical pages that were
+  mapped in it, the counterpart of mem_alloc_vblock
+*/
+void mem_free_vblock(void *vptr, size_t size);
 
 // Kernel virtual space
 #define KVMSPACE                                                               \
@@ -106,6 +124,12 @@ void *mem_alloc_into(void *vptr, size_t size, int flags);
 // KHEAP is 512 Gib in size, 1 PML4 page
 #define KHEAP ((void *)(0xFFFF808000000000))  // Kernel heap
 #define KHEAP_SIZE ((size_t)512 * 1024 * 1024 * 1024)
+// Slabs of the kernel object caches, grows upward, never reused
+#define KSLAB ((void *)(0xFFFF850000000000))
+#define KSLAB_SIZE ((size_t)1024 * 1024 * 1024 * 1024)
+// Large heap allocations, each in its own range with room to grow
+#define KHEAP_LARGE ((void *)(0xFFFF880000000000))
+#define KHEAP_LARGE_SIZE ((size_t)8 * 1024 * 1024 * 1024 * 1024)
 
 // MAPF memory mapping flags
 #define MAPF_R (1 << 0) /* Read */
@@ -1,9 +1,30 @@
 #ifndef HELIUM_MUTEX_H
 #define HELIUM_MUTEX_H
 
-typedef volatile int mutex;
+#include <stdbool.h>
+#include <stdint.h>
+#include <wait.h>
 
-void mutex_lock(mutex *);
-void mutex_ulock(mutex *);
+/*
+  Sleeping mutex, for long critical sections that may themselves wait. A
+  processor that finds the mutex taken spins a little first, as it is often
+  released quickly, and then sleeps on the mutex's wait queue until it is
+  unlocked. Mutexes cannot be taken in interrupt handlers.
+  Zero initialized mutexes are unlocked.
+*/
 
-#endif
\ No newline at end of file
+// Pause rounds spent spinning on a taken mutex before sleeping
+#define MUTEX_SPIN (256)
+
+struct MUTEX;
+typedef struct MUTEX mutex;
+struct MUTEX {
+  volatile uint32_t locked;
+  wait_queue        waiters;
+};
+
+void mutex_lock(mutex *mutex);
+bool mutex_trylock(mutex *mutex);
+void mutex_unlock(mutex *mutex);
+
+#endif
@@ -1,21 +1,23 @@
 #ifndef HELIUM_PROC_H
 #define HELIUM_PROC_H 0
 
+#include <attributes.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
 #include <arch/mem.h>
 
+// Per processor structures are sized for this many sysids
+#define PROC_MAX_COUNT (64)
+// Processors are found by APIC ID below this, the IDs of the MADT LAPIC
+// entries, processors with larger x2APIC IDs are not started
+#define PROC_MAX_APICID (256)
+
 #define KSTACK_SIZE (16 * 1024)
 #define NMI_STACK_SIZE (4 * 1024)
 #define DF_STACK_SIZE (4 * 1024)
 
-#define PROC_TABLE_VPTR (KVMSPACE + (uintptr_t)2 * 1024 * 1024 * 1024 * 1024)
-#define PROC_TABLE_VSIZE ((uintptr_t)2 * 1024 * 1024 * 1024 * 1024)
-
-#define STACK_TABLE_VPTR                                                       \
-  ((void **)(KVMSPACE + (uintptr_t)4 * 1024 * 1024 * 1024 * 1024))
-
 // One of these is created per CPU
 typedef struct PROC_INFO {
   size_t sysid;  // Assigned by Helium
@@ -29,15 +31,57 @@ typedef struct PROC_INFO {
   void *df_stack;
 } proc_info;
 
+struct TASK;
+
+// Per processor data, its address is the GS base while in the kernel, user
+// mode has its own, swapped on every entry and exit with swapgs. Each
+// processor only reads and writes its own
+struct PROC_CPU;
+typedef struct PROC_CPU proc_cpu;
+struct PROC_CPU {
+  proc_cpu *self;
+  // System calls land on the running task's stack, the user stack pointer
+  // is kept here until it is on it
+  void *kstack_top;
+  void *user_sp;
+
+  size_t     sysid;
+  uint32_t   apicid;
+  bool       primary;
+  proc_info *info;
+
+  struct TASK *cur;  // Running task, 0 in the idle task
+
+  uint64_t nr_switches;
+  uint64_t nr_syscalls;
+} cache_aligned;
+
+// Offsets used by the system call entry, in sys.asm
+#define PROC_CPU_KSTACK_TOP (8)
+#define PROC_CPU_USER_SP (16)
+
+// Fields of the calling processor's proc_cpu, one GS relative instruction
+#define this_cpu_read(field) (((proc_cpu volatile __seg_gs *)0)->field)
+#define this_cpu_write(field, val)                                             \
+  (((proc_cpu volatile __seg_gs *)0)->field = (val))
+#define this_cpu_inc(field) (++((proc_cpu volatile __seg_gs *)0)->field)
+#define this_cpu_ptr() (this_cpu_read(self))
+
+// Points GS at the processor's proc_cpu, first thing every processor does.
+// The other processors share a placeholder until they are started
+void proc_early_init();
+
 void proc_ignite();
 void proc_ignition_wait();
 void proc_init();
 
 uint32_t proc_getid();
+size_t   proc_sysid();
 int      proc_isprimary();
 
 uint32_t proc_bus_freq();
 
+proc_info *proc_create_info();
 void       proc_register(uint32_t apic_id, proc_info *info);
 size_t     proc_numcores();
 proc_info *proc_getinfo();
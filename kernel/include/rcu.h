@@ -0,0 +1,79 @@
+#ifndef HELIUM_RCU_H
+#define HELIUM_RCU_H
+
+#include <attributes.h>
+#include <proc.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+  Quiescent state based RCU. Readers only mark their read side sections
+  with rcu_read_lock/rcu_read_unlock, which cost nothing, and must not block
+  or go through a quiescent state inside them. Quiescent states are the
+  points where a processor cannot hold a reference: every pass through the
+  idle loop, every context switch, and every entry in the kernel from user
+  mode.
+  A grace period is over once every online processor has gone through a
+  quiescent state since it started, memory unpublished before it can then
+  be freed. synchronize_rcu waits for a grace period, call_rcu queues a
+  callback on the calling processor, callbacks queued in between two
+  quiescent states are batched on the same grace period.
+  An idle processor that stopped its tick reports no quiescent state, it
+  leaves grace periods with rcu_idle_enter while it sleeps, if it has no
+  callbacks of its own waiting. Interrupt handlers that may read protected
+  data on an idle processor call rcu_idle_exit first.
+*/
+
+struct RCU_HEAD;
+typedef struct RCU_HEAD rcu_head;
+
+typedef void (*rcu_callback_f)(rcu_head *head);
+
+// Embedded in the object to be freed, container_of style
+struct RCU_HEAD {
+  rcu_head      *next;
+  rcu_callback_f func;
+};
+
+struct RCU_CPU;
+typedef struct RCU_CPU rcu_cpu;
+struct RCU_CPU {
+  volatile uint64_t seen;  // Last grace period started before a quiescent
+                           // state of this processor
+  volatile bool online;
+  bool          idle;  // Offline for the idle loop, online otherwise
+
+  rcu_head  *next;  // Callbacks waiting for a grace period to start
+  rcu_head **next_tail;
+  rcu_head  *wait;  // Callbacks waiting for wait_gp to end
+  uint64_t   wait_gp;
+} cache_aligned;
+
+#define rcu_barrier() asm volatile("" ::: "memory")
+
+// Keep the compiler from moving accesses out of the read side section
+#define rcu_read_lock() rcu_barrier()
+#define rcu_read_unlock() rcu_barrier()
+
+// Publishes p, everything written to *v before is visible to readers first
+#define rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+#define rcu_dereference(p) __atomic_load_n(&(p), __ATOMIC_CONSUME)
+
+// Called by a processor once it takes part in grace periods, and at each of
+// its quiescent states, with interrupts enabled or not
+void rcu_online();
+void rcu_quiescent();
+
+// With interrupts disabled. rcu_needs_cpu returns true if callbacks of the
+// processor wait for grace periods, it must then keep reporting quiescent
+// states, rcu_idle_exit does nothing outside of rcu_idle_enter
+bool rcu_needs_cpu();
+void rcu_idle_enter();
+void rcu_idle_exit();
+
+// Neither can be called from an interrupt handler, synchronize_rcu should
+// not be called inside a read side section either
+void synchronize_rcu();
+void call_rcu(rcu_head *head, rcu_callback_f func);
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef HELIUM_SCHED_H
+#define HELIUM_SCHED_H
+
+#include <attributes.h>
+#include <lock.h>
+#include <proc.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <task.h>
+
+/*
+  Every processor has its own run queue of pending tasks, served round
+  robin, and an idle task, the boot context it started on, which runs when
+  the queue is empty. Tasks running in user mode are preempted by the timer
+  tick, vector 0xF0, once their slice is over and another task is pending
+  on the same processor. Kernel code is never preempted, it gives the
+  processor up by blocking on a wait queue, exiting, or with sched_yield,
+  so spinlocks and RCU read side sections are never held across a switch.
+  A context switch is an RCU quiescent state.
+  A processor with nothing to run steals the oldest pending task of the
+  busiest other queue, on every pass through its idle loop, pinned tasks
+  are left alone. Queues are looked at from the closest topology domain
+  out, see topology.h. Woken tasks go back to the queue of the processor
+  they last ran on, or to an idle one sharing its last level cache, or the
+  waker's, if it is busy. New tasks go to the least loaded processor, in
+  the least loaded package.
+  Idle processors stop their tick when they can, queueing a task kicks the
+  processor it goes to out of hlt, or if that one is busy, an idle one that
+  can steal it.
+*/
+
+// Ticks a task runs before it is preempted, if something else is pending
+#define SCHED_SLICE (10)
+
+struct SCHED_RQ;
+typedef struct SCHED_RQ sched_rq;
+struct SCHED_RQ {
+  spinlock lock;  // Protects the queue, taken with interrupts disabled
+  task    *head;
+  task    *tail;
+
+  volatile size_t len;
+  volatile size_t pinned;        // Pending tasks that cannot be stolen
+  volatile bool   need_resched;  // Slice of a kernel mode task is over
+  volatile bool   online;
+  volatile bool   sleeping;      // Halted in the idle loop
+
+  task      *cur;
+  task      *idle;
+  proc_info *pinfo;
+} cache_aligned;
+
+// Turns the calling context into the idle task of the processor and starts
+// scheduling, proc_info must be set up already
+noreturn void sched_start();
+
+// Queues a new task on the least loaded processor
+void sched_add(task *t);
+// Queues a new task on the processor with the given sysid, and pins it
+void sched_add_on(task *t, size_t sysid);
+// Gives the processor to the next pending task, if there is one
+void sched_yield();
+// Yields if the slice of the caller is over, for long running kernel code
+void sched_cond_yield();
+noreturn void sched_exit();
+
+// The running task, 0 until the scheduler runs on this processor and in the
+// idle task
+task *sched_current();
+
+// Sleeps until sched_wake, unless *woken is set already. The caller has
+// interrupts disabled, and sets *woken before calling sched_wake
+void sched_block(volatile bool *woken);
+// Queues t again if it is blocking, returns false otherwise
+bool sched_wake(task *t);
+
+// Called by the timer tick with interrupts disabled, returns true if the
+// running task should be preempted with sched_yield, the caller saves its
+// user mode state
+bool sched_tick(bool user);
+
+// First thing a new task runs, through as_task_start
+noreturn void sched_task_start(task *prev);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef HELIUM_SEMAPHORE_H
+#define HELIUM_SEMAPHORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wait.h>
+
+/*
+  Counting semaphore. sem_down takes one unit, sleeping until there is one,
+  sem_up gives one back and wakes a waiter. sem_trydown never sleeps, it is
+  the only one of them that may be used in interrupt handlers, along with
+  sem_up.
+*/
+
+struct SEMAPHORE;
+typedef struct SEMAPHORE semaphore;
+struct SEMAPHORE {
+  volatile int64_t count;
+  wait_queue       waiters;
+};
+
+void sem_init(semaphore *sem, int64_t count);
+
+void sem_down(semaphore *sem);
+bool sem_trydown(semaphore *sem);
+void sem_up(semaphore *sem);
+
+#endif
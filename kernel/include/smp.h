@@ -0,0 +1,81 @@
+#ifndef HELIUM_SMP_H
+#define HELIUM_SMP_H
+
+#include <attributes.h>
+#include <proc.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  Cross processor calls. Every processor has a lock free queue of calls to
+  run, pushed to by the others, and drained by the interrupt on
+  APIC_CALL_VECTOR. The interrupt is only sent when a queue goes from empty
+  to non empty, calls queued before the target gets to it are all run by the
+  same interrupt.
+  Every processor owns one call slot per target, a slot is reused once the
+  target has taken the call out of it, so nothing is allocated. Callers
+  keep interrupts disabled while queueing, and run the calls queued to them
+  while they spin, two processors calling each other cannot deadlock.
+  Calls run in the interrupt handler of the target, with interrupts
+  disabled, they must not block. A target waiting on a lock with interrupts
+  disabled runs them from the wait, the caller may hold that lock, so calls
+  must not take locks either.
+*/
+
+// Above this many pages, a user range is flushed by reloading CR3, kernel
+// pages are global and always go one by one
+#define SMP_TLB_FLUSH_THRESHOLD (32)
+
+// Bit n is the processor with sysid n
+typedef uint64_t cpu_mask;
+
+#define CPU_MASK_ALL (UINT64_MAX)
+#define CPU_MASK_OF(sysid) ((cpu_mask)1 << (sysid))
+
+typedef void (*smp_call_f)(void *arg);
+
+struct SMP_CALL;
+typedef struct SMP_CALL smp_call;
+struct SMP_CALL {
+  smp_call *volatile next;
+
+  smp_call_f fn;
+  void      *arg;
+  // Decremented once the call has run, when the caller waits for it
+  volatile size_t *done;
+  volatile bool    busy;  // Queued and not taken out by the target yet
+};
+
+struct SMP_CPU;
+typedef struct SMP_CPU smp_cpu;
+struct SMP_CPU {
+  smp_call *volatile head;  // Newest call first
+  uint32_t           apicid;
+
+  // Slots of this processor, by target sysid, away from the head the
+  // others push to
+  smp_call slots[PROC_MAX_COUNT] cache_aligned;
+} cache_aligned;
+
+// Takes the calling processor in, after apic_init
+void smp_online();
+// Processors that take calls
+cpu_mask smp_online_mask();
+
+// Runs fn(arg) on every online processor in mask, the caller included if
+// it is in it. If wait is set, returns once they all have, otherwise once
+// they all have been queued
+void smp_call_function(cpu_mask mask, smp_call_f fn, void *arg, bool wait);
+
+// Runs the calls queued to the calling processor, from the interrupt
+void smp_call_interrupt();
+// Runs them from a wait with interrupts disabled, nothing if they are enabled
+void smp_call_poll();
+
+// Invalidates [vadr, vadr+size) in the TLB of every other processor, and
+// waits for it, the caller invalidates its own. The caller may hold a lock
+// with interrupts disabled, processors waiting on it still run the flush
+void smp_tlb_shootdown(void *vadr, size_t size);
+
+#endif
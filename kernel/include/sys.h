@@ -8,4 +8,6 @@
 #define halt() asm("hlt")
 #define pause() asm("pause")
 
+#define rdtsc() __builtin_ia32_rdtsc()
+
 #endif
\ No newline at end of file
@@ -1,18 +1,52 @@
 #ifndef HELIUM_TASK_H
 #define HELIUM_TASK_H
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+// Size of the FXSAVE area
+#define TASK_FPU_SIZE (512)
 
 typedef enum TASK_STATE {
-  TASK_BLOCKING,
-  TASK_RUNNING,
-  TASK_PENDING,
-  TASK_ZOMBIE
+  TASK_BLOCKING,  // Waiting to be woken up, on no run queue
+  TASK_RUNNING,   // On a processor
+  TASK_PENDING,   // On a run queue
+  TASK_ZOMBIE     // Exited, freed once switched out
 } task_state;
 
-typedef struct TASK {
-  size_t     id;
-  task_state state;
-} task;
+typedef void (*task_entry_f)(void *arg);
+
+struct TASK;
+typedef struct TASK task;
+struct TASK {
+  size_t              id;
+  volatile task_state state;
+
+  void *ksp;         // Saved stack pointer while switched out
+  void *kstack;      // Lowest address of the kernel stack, 0 for idle tasks
+  void *kstack_top;  // Where interrupts and system calls from user mode land
+
+  // Set while a processor runs on the task's stack, a task can be queued
+  // again before it is completely switched out
+  volatile bool on_cpu;
+  size_t        cpu;     // Sysid of the run queue it was last on
+  bool          pinned;  // Never moved to another processor's queue
+  size_t        slice;   // Ticks left before it is preempted
+  task         *next;    // Run queue link
+
+  task_entry_f entry;
+  void        *arg;
+
+  // User mode state of a task preempted in user mode, the kernel uses SSE
+  // too, but never across a voluntary switch
+  uint8_t fpu[TASK_FPU_SIZE] __attribute__((aligned(16)));
+};
+
+// The task is not queued anywhere, sched_add starts it
+task *task_create(task_entry_f entry, void *arg);
+// Wraps the running boot stack in a task, for the idle task of a processor
+task *task_create_idle();
+void  task_destroy(task *t);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,64 @@
+#ifndef HELIUM_TIMER_H
+#define HELIUM_TIMER_H
+
+#include <attributes.h>
+#include <lock.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+  Every processor has a queue of timers, sorted by deadline, in clock
+  ticks. Busy processors run the periodic tick, which also drives the
+  scheduler's slices. An idle processor stops it, and sets its APIC timer
+  in one shot mode to the first deadline of its queue, or not at all if it
+  is empty, it is then only woken by interrupts. The BSP keeps ticking, it
+  keeps the clock and flushes the kernel terminal.
+  Timer callbacks run in the timer interrupt of the processor the timer
+  was added on, with interrupts disabled.
+  The APIC timer of every processor is calibrated against the TSC when it
+  starts.
+*/
+
+// Ticks the APIC timer is measured over
+#define TIMER_CALIBRATE_TICKS (2)
+
+typedef void (*ktimer_f)(void *arg);
+
+struct KTIMER;
+typedef struct KTIMER ktimer;
+struct KTIMER {
+  ktimer  *next;
+  uint64_t deadline;
+  size_t   cpu;  // Sysid of the queue it is on
+  bool     queued;
+
+  ktimer_f fn;
+  void    *arg;
+};
+
+struct TIMER_CPU;
+typedef struct TIMER_CPU timer_cpu;
+struct TIMER_CPU {
+  spinlock lock;  // Taken with interrupts disabled
+  ktimer  *head;
+  bool     tick_stopped;
+  uint32_t tick_count;  // APIC timer counts in a tick
+} cache_aligned;
+
+// Starts the periodic tick of the calling processor, after apic_init
+void timer_init();
+
+// Fires fn(arg) on the calling processor, at least ticks ticks from now
+void ktimer_add(ktimer *t, uint64_t ticks, ktimer_f fn, void *arg);
+// Returns false if the timer was not queued, it may be running
+bool ktimer_cancel(ktimer *t);
+
+// Runs the expired timers, from the timer interrupt
+void timer_interrupt();
+
+// For the idle loop, with interrupts disabled. Stopping returns false if
+// this processor has to keep ticking
+bool timer_tick_stop();
+void timer_tick_restart();
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef HELIUM_TOPOLOGY_H
+#define HELIUM_TOPOLOGY_H
+
+#include <attributes.h>
+#include <proc.h>
+#include <smp.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+  Where every processor sits, read from CPUID on the processor itself: its
+  x2APIC ID is split into SMT, core and package fields with leaf 0x1F, or
+  0xB, and the processors sharing its last level cache are found with leaf
+  4, or 0x8000001D on AMD. Without leaf 0xB, leaf 1 only gives the size of
+  the package, its processors are taken as cores, without the cache leaves
+  the package is the last level cache.
+  Each processor gets a hierarchy of domains, the masks of the processors
+  it shares a core, a last level cache, a package, and the machine with,
+  itself included. The scheduler looks for work and for idle processors
+  from the closest domain out.
+*/
+
+typedef enum TOPO_LEVEL {
+  TOPO_SMT,  // Same core
+  TOPO_LLC,  // Same last level cache
+  TOPO_PKG,  // Same package
+  TOPO_ALL,  // Every processor that went through topo_init
+  TOPO_LEVELS
+} topo_level;
+
+struct TOPO_CPU;
+typedef struct TOPO_CPU topo_cpu;
+struct TOPO_CPU {
+  uint32_t x2apicid;
+  uint32_t core_id;  // x2APIC ID without the SMT bits
+  uint32_t llc_id;   // x2APIC ID without the bits under the LLC
+  uint32_t pkg_id;   // x2APIC ID without the bits under the package
+  bool     online;
+
+  cpu_mask domains[TOPO_LEVELS];
+} cache_aligned;
+
+// Reads the topology of the calling processor, and adds it to the domains
+// of the others, in proc_init
+void topo_init();
+
+// Domain of the processor with the given sysid, 0 until it is initialized
+cpu_mask topo_domain(size_t sysid, topo_level level);
+
+#endif
@@ -8,15 +8,14 @@
 #define USPACE_STACK_TOP ((void *)(USPACE_STACK_BASE - USPACE_STACK_SIZE))
 
 void exec();
+// Called by as_syscall_handle, with the number and the arguments in the
+// order they are passed in registers
 uint64_t syscall(
-    uint64_t rdi,
-    uint64_t rsi,
-    uint64_t rdx,
-    uint64_t rcx,
-    uint8_t  r8,
-    uint64_t r9
+    uint64_t num, uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3,
+    uint64_t a4
 );
 
+#define SYSCALL_FIRST (0x10)
 #define SYSCALL_EXIT (0x10)
 #define SYSCALL_PRINT (0x11)
 #define SYSCALL_GETS (0x12)
@@ -24,5 +23,10 @@ uint64_t syscall(
 #define SYSCALL_CLEAR (0x14)
 #define SYSCALL_KCFG (0x15)
 #define SYSCALL_KCBG (0x16)
+#define SYSCALL_LOCKSTAT (0x17)
+#define SYSCALL_CTXBENCH (0x18)
+#define SYSCALL_NOP (0x19)
+#define SYSCALL_MALLOCBENCH (0x1A)
+#define SYSCALL_COUNT (SYSCALL_MALLOCBENCH - SYSCALL_FIRST + 1)
 
 #endif
\ No newline at end of file
@@ -23,7 +23,15 @@ void        vcache_remap(vcache_unit unit, void *padr);
 void vcache_umap(vcache_unit unit, void *id);
 
 #define VCACHE_PTR (KVMSPACE)
-#define VCACHE_LEN (2048)
+
+// Every processor owns a private slice of the VCache, a slice is exactly one
+// PDE worth of pages. Pages of a slice are only ever mapped, remapped and
+// invalidated by the processor owning it, so no locking nor cross processor
+// invalidation is needed. A vcache_unit must not be handed to another core.
+#define VCACHE_SLICE_LEN (512)
+#define VCACHE_SLICE_COUNT (PROC_MAX_COUNT)
+
+#define VCACHE_LEN (VCACHE_SLICE_LEN * VCACHE_SLICE_COUNT)
 #define VCACHE_SIZE (VCACHE_LEN * MEM_PS)
 
 // Index of the PML4E used by the vcache(only one)
@@ -31,14 +39,14 @@ void vcache_umap(vcache_unit unit, void *id);
 // Index of the PDPTE used by the vcache(only one, parent index is PML4E_IDX)
 #define PDPTE_IDX (ENTRY_IDX(2, VCACHE_PTR))
 
-#define PDE_COUNT (VCACHE_LEN / 512)
+#define PDE_COUNT (VCACHE_SLICE_COUNT)
 
 // This pointer, after memory initialization, should point
-// to 4 consecutive PDEs that are used for VCache
+// to PDE_COUNT consecutive PDEs that are used for VCache, one per slice
 extern mem_pde_ref *i_vcache_pde;
 
 // Pointer to the first PTE used by VCache. This PTE should be
-// followed by another 2047 PTE
+// followed by another VCACHE_LEN - 1 PTEs
 extern mem_pte *i_vcache_pte;
 
 #endif
\ No newline at end of file
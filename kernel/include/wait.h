@@ -0,0 +1,66 @@
+#ifndef HELIUM_WAIT_H
+#define HELIUM_WAIT_H
+
+#include <lock.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <task.h>
+
+/*
+  Wait queues. wait_event(wq, cond) returns once cond is true, until then
+  the processor sleeps instead of spinning. Whoever makes cond true calls
+  wake_up, or wake_up_all, on the same queue. The waiter is queued before
+  cond is checked, so a wake up is never missed between the two, and cond is
+  checked again after every wake up, so it is fine to wake more than needed.
+  A waiting task is switched out, the processor runs other tasks until it
+  is woken. Outside of a task, before the scheduler starts or in the idle
+  task, waiting parks the processor in mwait on the waiter's own wake up
+  flag when the processor has it, otherwise in hlt, where it is woken by the
+  next interrupt, the timer tick at the latest. Waits with interrupts
+  disabled cannot switch out or halt, they only sleep with mwait, or spin.
+  cond is evaluated with interrupts disabled. Waiting must not happen in an
+  interrupt handler, nor while holding a spinlock or in an RCU read side
+  section, it is a quiescent state.
+  Zero initialized queues are empty.
+*/
+
+struct WAIT_ENTRY;
+typedef struct WAIT_ENTRY wait_entry;
+struct WAIT_ENTRY {
+  wait_entry   *next;
+  wait_entry   *prev;
+  volatile bool woken;
+  bool          queued;
+  task         *task;  // Switched out while waiting, if not null
+};
+
+struct WAIT_QUEUE;
+typedef struct WAIT_QUEUE wait_queue;
+struct WAIT_QUEUE {
+  spinlock    lock;
+  wait_entry *head;
+  wait_entry *tail;
+};
+
+// Queues entry and disables interrupts, returns the previous RFLAGS
+uint64_t wait_prepare(wait_queue *wq, wait_entry *entry);
+// Sleeps until entry is woken, returns with entry queued again
+void     wait_block(wait_queue *wq, wait_entry *entry, uint64_t rflags);
+// Takes entry off the queue and restores interrupts
+void     wait_finish(wait_queue *wq, wait_entry *entry, uint64_t rflags);
+
+#define wait_event(wq, cond)                                                   \
+  do {                                                                         \
+    wait_entry __wait;                                                         \
+    uint64_t   __rflags = wait_prepare((wq), &__wait);                         \
+    while (!(cond)) {                                                          \
+      wait_block((wq), &__wait, __rflags);                                     \
+    }                                                                          \
+    wait_finish((wq), &__wait, __rflags);                                      \
+  } while (0)
+
+// Wakes the waiter queued first
+void wake_up(wait_queue *wq);
+void wake_up_all(wait_queue *wq);
+
+#endif
@@ -1,4 +1,5 @@
 #include <acpi.h>
+#include <arena.h>
 #include <boot_info.h>
 #include <cfgtb.h>
 #include <mem.h>
@@ -6,13 +7,27 @@
 #include <string.h>
 #include <utils.h>
 
-#include <dts/hashtable.h>
-
-static void *map_table(
-    dts_hashtable *acpi_vmemmap, void *padr, size_t *pgindex
-) {
+// Physical pages of ACPI tables already mapped, only needed while walking
+// the tables
+struct ACPI_MAPPING;
+typedef struct ACPI_MAPPING acpi_mapping;
+struct ACPI_MAPPING {
+  void         *padr;
+  void         *vadr;
+  acpi_mapping *next;
+};
+
+struct ACPI_WALK;
+typedef struct ACPI_WALK acpi_walk;
+struct ACPI_WALK {
+  arena        *scratch;
+  acpi_mapping *mappings;
+  size_t        pgindex;
+};
+
+static void *map_table(acpi_walk *walk, void *padr) {
   void *al_padr = (void *)((uintptr_t)padr & 0xFFFFFFFFFFFFF000);
-  void *vadr    = ACPI_TABLE_VBASE + *pgindex * 0x1000;
+  void *vadr    = ACPI_TABLE_VBASE + walk->pgindex * 0x1000;
 
   // Not C++'s VTable
 
@@ -21,37 +36,37 @@ static void *map_table(
   acpi_header *vtable = vadr + (uintptr_t)padr % 0x1000;
   size_t       alsize = ALIGN_UP(vtable->len, 0x1000);
 
-  *pgindex += 1;
+  walk->pgindex += 1;
 
   if (alsize > 0x1000) {
     size_t rest = alsize - 0x1000;
     mem_vmap(vadr + 0x1000, al_padr + 0x1000, rest, 0);
-    *pgindex += rest / 0x1000;
+    walk->pgindex += rest / 0x1000;
   }
 
-  dts_hashtable_insert(acpi_vmemmap, al_padr, vadr);
+  acpi_mapping *mapping = arena_alloc(walk->scratch, sizeof(*mapping));
+  mapping->padr         = al_padr;
+  mapping->vadr         = vadr;
+  mapping->next         = walk->mappings;
+  walk->mappings        = mapping;
 
   return vtable;
 }
 
-static void *get_vadr(
-    dts_hashtable *acpi_vmemmap, void *padr, size_t *pgindex
-) {
+static void *get_vadr(acpi_walk *walk, void *padr) {
   void  *al_padr = (void *)((uintptr_t)padr & 0xFFFFFFFFFFFFF000);
   size_t mod     = (uintptr_t)padr % 0x1000;
-  bool   found   = false;
 
-  void *res = dts_hashtable_search(acpi_vmemmap, al_padr, &found);
-  if (found) {
-    return res + mod;
+  for (acpi_mapping *m = walk->mappings; m; m = m->next) {
+    if (m->padr == al_padr) {
+      return m->vadr + mod;
+    }
   }
 
-  return map_table(acpi_vmemmap, padr, pgindex);
+  return map_table(walk, padr);
 }
 
-static void walk_acpi_recursive(
-    acpi_header *head, dts_hashtable *acpi_vmemmap, size_t *pgindex
-) {
+static void walk_acpi_recursive(acpi_header *head, acpi_walk *walk) {
   // Verify checksum
   uint8_t checksum = memsum(head, head->len);
   if (checksum) {
@@ -65,9 +80,8 @@ static void walk_acpi_recursive(
     printd("\n");
     for (size_t i = 0; i < nentries; ++i) {
       // Find if this physical page is already mapped
-      acpi_header *next_table =
-          get_vadr(acpi_vmemmap, (void *)table->ss_list[i], pgindex);
-      walk_acpi_recursive(next_table, acpi_vmemmap, pgindex);
+      acpi_header *next_table = get_vadr(walk, (void *)table->ss_list[i]);
+      walk_acpi_recursive(next_table, walk);
     }
   } else {
     if (!cfgtb_acpi_callhandlers((char *)head, head)) {
@@ -77,11 +91,10 @@ static void walk_acpi_recursive(
 }
 
 void acpi_lookup() {
-  dts_hashtable *acpi_vmemmap = dts_hashtable_create_uptrkey(0);
-  size_t         pgindex      = 0;
+  acpi_walk walk = {.scratch = arena_create(0), .mappings = 0, .pgindex = 0};
 
-  acpi_header *xsdt =
-      get_vadr(acpi_vmemmap, (void *)bootboot.arch.x86_64.acpi_ptr, &pgindex);
+  acpi_header *xsdt = get_vadr(&walk, (void *)bootboot.arch.x86_64.acpi_ptr);
+  walk_acpi_recursive(xsdt, &walk);
 
-  walk_acpi_recursive(xsdt, acpi_vmemmap, &pgindex);
+  arena_destroy(walk.scratch);
 }
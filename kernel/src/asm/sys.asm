@@ -1,9 +1,12 @@
 global as_sys_stop
-global as_event_loop
 global as_syscall_handle
 
 extern syscall
 
+; Offsets in proc_cpu, see proc.h
+%define PROC_CPU_KSTACK_TOP 8
+%define PROC_CPU_USER_SP 16
+
 section .text
 
 as_sys_stop:
@@ -12,59 +15,38 @@ as_sys_stop:
   hlt
   jmp .loop
 
-as_event_loop:
-  sti
-.loop:
-  hlt
-  jmp .loop
-
+; The caller of syscall expects the scratch registers of the C calling
+; convention to be clobbered, rcx and r11 are by the instruction itself, the
+; callee saved ones are saved by syscall() if it uses them, so the only state
+; to keep is the user stack pointer, instruction pointer and flags
 as_syscall_handle:
-  push rbx
+  ; Interrupts are masked until the kernel GS base and stack are back
+  swapgs
+  mov [gs:PROC_CPU_USER_SP], rsp
+  mov rsp, [gs:PROC_CPU_KSTACK_TOP]
+
+  ; The fourth push keeps the stack aligned for the call
+  push qword [gs:PROC_CPU_USER_SP]
   push rcx
-  push rdx
-  push rbp
-  push rdi
-  push rsi
-  push r8
-  push r9
-  push r10
   push r11
-  push r12
-  push r13
-  push r14
-  push r15
-    ; We need to get the location of the kernel stack for the current processor
-    ; Without using the stack, this is done through the stack table
-    ; Put by the kernel init at 0xFFFF840000000000
-    push rdx
-      mov rax, 1
-      cpuid
-      shr rbx, 24
-    pop rdx
+  push r11
+  sti
 
-    mov rax, 0xFFFF840000000000
-    shl rbx, 3
-    add rax, rbx
-    mov r15, [rax]
+  mov rcx, r10 ; arg 4
+  call syscall
 
-    mov rbp, rsp
-    mov rsp, r15
-    mov rcx, r10; arg 4
-    push rbp
-      call syscall
-    pop rsp
-  pop r15
-  pop r14
-  pop r13
-  pop r12
+  ; Kernel values are not left behind in the scratch registers
+  xor esi, esi
+  xor edi, edi
+  xor edx, edx
+  xor r8d, r8d
+  xor r9d, r9d
+  xor r10d, r10d
+
+  cli
+  add rsp, 8
   pop r11
-  pop r10
-  pop r9
-  pop r8
-  pop rsi
-  pop rdi
-  pop rbp
-  pop rdx
   pop rcx
-  pop rbx
+  pop rsp
+  swapgs
   o64 sysret
@@ -0,0 +1,35 @@
+global as_task_switch
+global as_task_start
+
+extern sched_task_start
+
+section .text
+
+; rdi: save_sp
+; rsi: load_sp
+; rdx: prev
+; Everything else is caller saved, the FPU included
+as_task_switch:
+  push rbp
+  push rbx
+  push r12
+  push r13
+  push r14
+  push r15
+
+  mov [rdi], rsp
+  mov rsp, rsi
+  mov rax, rdx
+
+  pop r15
+  pop r14
+  pop r13
+  pop r12
+  pop rbx
+  pop rbp
+  ret
+
+; rax: task switched from
+as_task_start:
+  mov rdi, rax
+  jmp sched_task_start
@@ -6,6 +6,10 @@ section .text
 ; rsi: stack
 ; rdx: rflags
 as_call_userspace:
+  ; The kernel GS base is kept in KERNEL_GS_BASE while in user mode, loading
+  ; gs below clears the active one
+  cli
+  swapgs
   mov ax, 0x1B
   mov ds, ax
   mov es, ax
@@ -37,6 +41,13 @@ as_enable_syscall:
   mov edx, 0x00130008
   wrmsr
 
+  ; Mask IF, TF, DF, AC and NT on entry, the kernel never runs with flags
+  ; left by user mode, as_syscall_handle enables interrupts again
+  mov rcx, 0xC0000084 ; IA32_FMASK
+  mov eax, 0x47700
+  xor edx, edx
+  wrmsr
+
   ; Enable syscall through EFER
   mov rcx, 0xc0000080
 	rdmsr
@@ -1,13 +1,17 @@
 #include <apic.h>
 #include <cfgtb.h>
+#include <lock.h>
 #include <string.h>
 
 #include <dts/stack.h>
 
-static dts_hashtable *acpi_handlers;
+// Handlers are registered at boot, before the tables are parsed, the
+// handlers of a signature are looked up without locking
+static dts_chashtable *acpi_handlers;
+static spinlock        acpi_register_lock = {0};
 
 void cfgtb_init() {
-  acpi_handlers = dts_hashtable_create_uptrkey(0);
+  acpi_handlers = dts_chashtable_create_uptrkey(0);
 
   cfgtb_acpi_register("APIC", apic_acpi_entry_handler);
 }
@@ -18,14 +22,18 @@ void cfgtb_acpi_register(char *entry_sig, cfgtb_acpi_handler handler) {
   uintptr_t sig = 0;
   memcpy(&sig, entry_sig, 4);
 
+  spin_lock(&acpi_register_lock);
+
   dts_stack *handlers_stack =
-      dts_hashtable_search(acpi_handlers, (void *)sig, 0);
+      dts_chashtable_search(acpi_handlers, (void *)sig, 0);
   if (!handlers_stack) {
     handlers_stack = dts_stack_create(sizeof(uintptr_t), 0);
-    dts_hashtable_insert(acpi_handlers, (void *)sig, handlers_stack);
+    dts_chashtable_insert(acpi_handlers, (void *)sig, handlers_stack);
   }
 
   dts_stack_push(handlers_stack, &handler);
+
+  spin_unlock(&acpi_register_lock);
 }
 
 size_t cfgtb_acpi_callhandlers(char *entry_sig, acpi_header *table) {
@@ -33,7 +41,7 @@ size_t cfgtb_acpi_callhandlers(char *entry_sig, acpi_header *table) {
   memcpy(&sig, entry_sig, 4);
 
   dts_stack *handlers_stack =
-      dts_hashtable_search(acpi_handlers, (void *)sig, 0);
+      dts_chashtable_search(acpi_handlers, (void *)sig, 0);
   if (!handlers_stack) {
     return 0;
   }
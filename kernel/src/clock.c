@@ -0,0 +1,229 @@
+#include <clock.h>
+#include <env.h>
+#include <lock.h>
+#include <proc.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys.h>
+
+#include <asm/io.h>
+#include <asm/msr.h>
+
+#define PIT_HZ (1193182)
+
+// Channel 2 gate and speaker in bits 0 and 1, channel 2 output in bit 5
+#define PIT_PORT_CTRL (0x61)
+#define PIT_PORT_CH2 (0x42)
+#define PIT_PORT_CMD (0x43)
+
+// Written by the BSP on every tick, read by anyone, readers never write to
+// it, so they do not fight over its cache line
+static seqlock  clock_lock  = {0};
+static uint64_t clock_ticks = 0;
+static uint64_t clock_tsc   = 0;
+
+// Only written by clock_init, before any other processor runs
+static uint64_t tsc_hz   = 0;
+static uint64_t tsc_base = 0;
+static uint64_t tsc_mult = 0;  // Nanoseconds per cycle, 32.32 fixed point
+
+// Added to the TSC of processors that could not adjust it, by sysid
+static int64_t tsc_offsets[PROC_MAX_COUNT];
+static bool    tsc_use_offsets = false;
+static bool    has_rdtscp      = false;
+
+// Handshake of clock_sync, one processor at a time talks to the BSP
+static spinlock          sync_lock  = {0};
+static volatile uint64_t sync_req   = 0;  // Round asked for
+static volatile uint64_t sync_resp  = 0;  // Round answered
+static volatile uint64_t sync_tsc   = 0;  // BSP TSC of the answer
+static volatile size_t   sync_count = 0;  // Processors done
+
+// Returns the TSC cycles in ms milliseconds of PIT channel 2, 0 if the PIT
+// does not count
+static uint64_t pit_measure(uint32_t ms) {
+  uint32_t count    = PIT_HZ / 1000 * ms;
+  uint64_t deadline = (uint64_t)CLOCK_CALIBRATE_MAX_MHZ * 1000 * ms * 4;
+
+  // Gate on, speaker off, channel 2 in mode 0 counts down once
+  as_outb(PIT_PORT_CTRL, (as_inb(PIT_PORT_CTRL) & ~0x02) | 0x01);
+  as_outb(PIT_PORT_CMD, 0xB0);
+  as_outb(PIT_PORT_CH2, count & 0xFF);
+  as_outb(PIT_PORT_CH2, count >> 8);
+
+  uint64_t start = rdtsc();
+  uint64_t end   = start;
+  while (!(as_inb(PIT_PORT_CTRL) & 0x20)) {
+    end = rdtsc();
+    // Well past the run at any TSC rate, no PIT there
+    if (end - start > deadline) {
+      return 0;
+    }
+  }
+  return end - start;
+}
+
+static uint64_t pit_calibrate() {
+  uint64_t best = 0;
+  for (size_t i = 0; i < CLOCK_CALIBRATE_RUNS; ++i) {
+    uint64_t cycles = pit_measure(CLOCK_CALIBRATE_MS);
+    if (!cycles) {  // The next runs would time out too
+      return 0;
+    }
+    if (!best || cycles < best) {
+      best = cycles;
+    }
+  }
+  return best * 1000 / CLOCK_CALIBRATE_MS;
+}
+
+static uint64_t read_tsc() {
+  if (!tsc_use_offsets) {
+    return rdtsc();
+  }
+
+  // TSC_AUX holds the sysid, read along with the TSC, so the offset is the
+  // one of the processor the TSC was read on
+  uint32_t sysid;
+  uint64_t tsc = __builtin_ia32_rdtscp(&sysid);
+  return tsc + tsc_offsets[sysid];
+}
+
+void clock_init() {
+  tsc_hz = env_tschz();
+  if (!tsc_hz) {
+    tsc_hz = pit_calibrate();
+  }
+
+  // Every processor keeps its sysid in TSC_AUX, read_tsc needs it
+  has_rdtscp = env_hasrdtscp();
+  if (has_rdtscp) {
+    as_lmsr(MSR_IA32_TSC_AUX, proc_sysid());
+  }
+
+  if (!tsc_hz) {
+    printd("Could not calibrate the TSC, falling back to the tick clock\n");
+    return;
+  }
+  if (!env_hasinvtsc()) {
+    printd("TSC is not invariant, time may drift in low power states\n");
+  }
+
+  tsc_mult = ((uint64_t)1000 * 1000 * 1000 << 32) / tsc_hz;
+  tsc_base = rdtsc();
+  printd("TSC frequency: %lu Hz\n", tsc_hz);
+}
+
+void clock_sync() {
+  if (!tsc_hz) {
+    return;
+  }
+  if (has_rdtscp) {
+    as_lmsr(MSR_IA32_TSC_AUX, proc_sysid());
+  }
+
+  int64_t  offset = 0;
+  uint64_t rtt    = UINT64_MAX;
+
+  spin_lock(&sync_lock);
+  for (size_t i = 0; i < CLOCK_SYNC_ROUNDS; ++i) {
+    uint64_t round = sync_req + 1;
+    uint64_t t0    = rdtsc();
+    __atomic_store_n(&sync_req, round, __ATOMIC_RELEASE);
+
+    // The BSP gives up after a while, and so do we
+    bool answered = true;
+    while (__atomic_load_n(&sync_resp, __ATOMIC_ACQUIRE) != round) {
+      if (rdtsc() - t0 > tsc_hz / 100) {
+        answered = false;
+        break;
+      }
+      pause();
+    }
+    if (!answered) {
+      break;
+    }
+    uint64_t t1 = rdtsc();
+
+    // The BSP read its TSC about halfway through, the fastest round trip
+    // bounds the error the best
+    if (t1 - t0 < rtt) {
+      rtt    = t1 - t0;
+      offset = (int64_t)(sync_tsc - (t0 + (t1 - t0) / 2));
+    }
+  }
+  ++sync_count;
+  spin_unlock(&sync_lock);
+
+  // Within what we can measure, nothing to do
+  if (rtt == UINT64_MAX || (offset < 0 ? -offset : offset) <= (int64_t)rtt) {
+    return;
+  }
+
+  if (env_hastscadjust()) {
+    as_lmsr(
+        MSR_IA32_TSC_ADJUST, as_smsr(MSR_IA32_TSC_ADJUST) + (uint64_t)offset
+    );
+  } else if (has_rdtscp) {
+    tsc_offsets[proc_sysid()] = offset;
+    tsc_use_offsets           = true;
+  } else {
+    printd("[Proc %&] TSC is off by %ld cycles\n", offset);
+  }
+}
+
+void clock_sync_serve(size_t aps) {
+  if (!tsc_hz) {
+    return;
+  }
+
+  // Gives up on processors that do not show up, a tenth of a second after
+  // the last one
+  uint64_t last = rdtsc();
+  while (sync_count < aps && rdtsc() - last < tsc_hz / 10) {
+    uint64_t req = __atomic_load_n(&sync_req, __ATOMIC_ACQUIRE);
+    if (req != sync_resp) {
+      sync_tsc = rdtsc();
+      __atomic_store_n(&sync_resp, req, __ATOMIC_RELEASE);
+      last = rdtsc();
+    }
+    pause();
+  }
+}
+
+uint64_t clock_tsc_hz() {
+  return tsc_hz;
+}
+
+uint64_t ktime_ns() {
+  if (!tsc_hz) {
+    return clock_uptime_ns();
+  }
+  return ((unsigned __int128)(read_tsc() - tsc_base) * tsc_mult) >> 32;
+}
+
+void clock_tick() {
+  uint64_t rflags = seq_write_lock(&clock_lock);
+  ++clock_ticks;
+  clock_tsc = rdtsc();
+  seq_write_unlock(&clock_lock, rflags);
+}
+
+void clock_read(uint64_t *ticks, uint64_t *tsc) {
+  uint32_t seq;
+  do {
+    seq    = seq_read_begin(&clock_lock);
+    *ticks = clock_ticks;
+    *tsc   = clock_tsc;
+  } while (seq_read_retry(&clock_lock, seq));
+}
+
+uint64_t clock_uptime_ns() {
+  if (tsc_hz) {
+    return ktime_ns();
+  }
+
+  uint64_t ticks, tsc;
+  clock_read(&ticks, &tsc);
+  return ticks * CLOCK_TICK_NS;
+}
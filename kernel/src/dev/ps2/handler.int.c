@@ -9,6 +9,8 @@
 #include "ps2.h"
 
 interrupt_handler void ps2_kbd_int(int_frame *frame) {
+  int_swapgs(frame);
+
   uint8_t scancode = as_inb(PS2_PORT_DATA);
   int     press    = !(scancode & 0x80);
   scancode &= 0x7F;
@@ -51,4 +53,5 @@ interrupt_handler void ps2_kbd_int(int_frame *frame) {
   }
 defer:
   apic_eoi();
+  int_swapgs(frame);
 }
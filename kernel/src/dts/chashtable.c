@@ -0,0 +1,455 @@
+#include <interrupts.h>
+#include <kmem.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dts/chashtable.h>
+
+// Nodes of all concurrent hashtables come from the same object cache
+static kmem_cache *node_cache      = 0;
+static spinlock    node_cache_lock = {0};
+
+static int uptr_cmp(void const *k1, void const *k2) {
+  return ((uintptr_t)k1 > (uintptr_t)k2) - ((uintptr_t)k1 < (uintptr_t)k2);
+}
+
+static dts_chashtable_table *table_create(size_t nbuckets) {
+  dts_chashtable_table *table = calloc(
+      1, sizeof(dts_chashtable_table) + nbuckets * sizeof(dts_chashtable_bucket)
+  );
+  if (table) {
+    table->nbuckets = nbuckets;
+  }
+  return table;
+}
+
+static inline dts_chashtable_bucket *table_bucket(
+    dts_chashtable_table *table, size_t hash
+) {
+  return table->buckets + hash % table->nbuckets;
+}
+
+static dts_chashtable_node *bucket_find(
+    dts_chashtable *ht, dts_chashtable_bucket *bucket, void const *key
+) {
+  dts_chashtable_node *current = rcu_dereference(bucket->head);
+  while (current && ht->keycmp(key, current->key)) {
+    current = rcu_dereference(current->next);
+  }
+  return current;
+}
+
+static void node_free(rcu_head *head) {
+  dts_chashtable_node *node =
+      (void *)head - offsetof(dts_chashtable_node, rcu);
+
+  if (node->own_key) {
+    free(node->key);
+  }
+  if (node->own_obj) {
+    free(node->obj);
+  }
+  kmem_cache_free(node_cache, node);
+}
+
+static void state_free(rcu_head *head) {
+  dts_chashtable_state *state =
+      (void *)head - offsetof(dts_chashtable_state, rcu);
+
+  // A state retired at the end of a resize takes the moved table with it
+  free(state->old);
+  free(state);
+}
+
+// Publishes a new state and frees the previous one after a grace period
+static bool state_replace(
+    dts_chashtable *ht, dts_chashtable_table *cur, dts_chashtable_table *old
+) {
+  dts_chashtable_state *state = calloc(1, sizeof(dts_chashtable_state));
+  if (!state) {
+    return false;
+  }
+  state->cur = cur;
+  state->old = old;
+
+  dts_chashtable_state *prev = ht->state;
+  rcu_assign_pointer(ht->state, state);
+  if (prev) {
+    call_rcu(&prev->rcu, state_free);
+  }
+  return true;
+}
+
+dts_chashtable *dts_chashtable_create_strkey(size_t esize) {
+  return dts_chashtable_create(
+      esize,
+      DTS_CHASHTABLE_MAX_LOAD,
+      DTS_CHASHTABLE_INIT_BUCKETS,
+      (dts_keycmp_f)strcmp,
+      (dts_keylen_f)strlen,
+      dts_hashtable_std_strhash
+  );
+}
+dts_chashtable *dts_chashtable_create_uptrkey(size_t esize) {
+  return dts_chashtable_create(
+      esize,
+      DTS_CHASHTABLE_MAX_LOAD,
+      DTS_CHASHTABLE_INIT_BUCKETS,
+      uptr_cmp,
+      NULL,
+      dts_hashtable_std_uptrhash
+  );
+}
+
+dts_chashtable *dts_chashtable_create(
+    size_t       esize,
+    size_t       max_load,
+    size_t       init_nbuckets,
+    dts_keycmp_f keycmp,
+    dts_keylen_f keylen,
+    dts_hash_f   hash
+) {
+  if (!node_cache) {
+    spin_lock(&node_cache_lock);
+    if (!node_cache) {
+      node_cache = kmem_cache_create(
+          "dts_chashtable_node", sizeof(dts_chashtable_node), 0, 0
+      );
+    }
+    spin_unlock(&node_cache_lock);
+    if (!node_cache) {
+      return 0;
+    }
+  }
+
+  dts_chashtable *ht = calloc(1, sizeof(dts_chashtable));
+  if (!ht) {
+    return 0;
+  }
+
+  dts_chashtable_table *table = table_create(init_nbuckets);
+  if (!table || !state_replace(ht, table, 0)) {
+    free(table);
+    free(ht);
+    return 0;
+  }
+
+  ht->objsize  = esize;
+  ht->max_load = max_load;
+
+  ht->keycmp = keycmp;
+  ht->keylen = keylen;
+  ht->hash   = hash;
+
+  return ht;
+}
+
+static void table_destroy(
+    dts_chashtable               *ht,
+    dts_chashtable_table         *table,
+    dts_chashtable_destroy_pair_f destroy_pair
+) {
+  for (size_t i = 0; i < table->nbuckets; ++i) {
+    dts_chashtable_node *current = table->buckets[i].head;
+    while (current) {
+      dts_chashtable_node *next = current->next;
+      if (destroy_pair) {
+        destroy_pair(ht, current->key, current->obj);
+      } else {
+        if (current->own_key) {
+          free(current->key);
+        }
+        if (current->own_obj) {
+          free(current->obj);
+        }
+      }
+      kmem_cache_free(node_cache, current);
+      current = next;
+    }
+  }
+  free(table);
+}
+
+void dts_chashtable_destroy(
+    dts_chashtable *ht, dts_chashtable_destroy_pair_f destroy_pair
+) {
+  // Buckets of old that were moved are empty, the others are not in cur
+  if (ht->state->old) {
+    table_destroy(ht, ht->state->old, destroy_pair);
+  }
+  table_destroy(ht, ht->state->cur, destroy_pair);
+
+  free(ht->state);
+  free(ht);
+}
+
+// Moves a bucket of old to cur, with the resize lock held, returns false if
+// the copies of its nodes could not be allocated
+static bool bucket_migrate(
+    dts_chashtable *ht, dts_chashtable_table *cur, dts_chashtable_bucket *bucket
+) {
+  // Readers may be walking the chain, its nodes cannot be relinked, they are
+  // copied to cur, and freed once no one can see them anymore
+  spin_lock(&bucket->lock);
+
+  dts_chashtable_node *copies = 0;
+  for (dts_chashtable_node *node = bucket->head; node; node = node->next) {
+    dts_chashtable_node *copy = kmem_cache_alloc(node_cache);
+    if (!copy) {
+      while (copies) {
+        copy = copies->next;
+        kmem_cache_free(node_cache, copies);
+        copies = copy;
+      }
+      spin_unlock(&bucket->lock);
+      return false;
+    }
+    copy->next = copies;
+    copies     = copy;
+  }
+
+  for (dts_chashtable_node *node = bucket->head; node; node = node->next) {
+    dts_chashtable_node *copy = copies;
+    copies                    = copy->next;
+
+    copy->key     = node->key;
+    copy->obj     = node->obj;
+    copy->objsize = node->objsize;
+    copy->own_key = node->own_key;
+    copy->own_obj = node->own_obj;
+    node->own_key = false;
+    node->own_obj = false;
+
+    dts_chashtable_bucket *target = table_bucket(cur, ht->hash(node->key));
+    spin_lock(&target->lock);
+    copy->next = target->head;
+    rcu_assign_pointer(target->head, copy);
+    spin_unlock(&target->lock);
+  }
+
+  // Every node is in cur now, readers that miss them here find them there
+  dts_chashtable_node *node = bucket->head;
+  rcu_assign_pointer(bucket->head, 0);
+  spin_unlock(&bucket->lock);
+
+  while (node) {
+    dts_chashtable_node *next = node->next;
+    call_rcu(&node->rcu, node_free);
+    node = next;
+  }
+  return true;
+}
+
+// Starts a resize if the table is loaded enough, or moves a few more
+// buckets if one is going on
+static void table_maintain(dts_chashtable *ht) {
+  dts_chashtable_state *state = ht->state;
+  if (!state->old && ht->count <= state->cur->nbuckets * ht->max_load) {
+    return;
+  }
+
+  uint64_t rflags = spin_lock_irqsave(&ht->resize_lock);
+  state           = ht->state;
+
+  if (!state->old) {
+    size_t nbuckets = state->cur->nbuckets;
+    if (ht->count > nbuckets * ht->max_load) {
+      dts_chashtable_table *table = table_create(nbuckets * 2);
+      if (table && !state_replace(ht, table, state->cur)) {
+        free(table);
+      }
+      ht->migrated = 0;
+    }
+    spin_unlock_irqrestore(&ht->resize_lock, rflags);
+    return;
+  }
+
+  for (size_t i = 0; i < DTS_CHASHTABLE_MIGRATE; ++i) {
+    if (ht->migrated == state->old->nbuckets) {
+      state_replace(ht, state->cur, 0);
+      break;
+    }
+    if (!bucket_migrate(ht, state->cur, state->old->buckets + ht->migrated)) {
+      break;
+    }
+    ++ht->migrated;
+  }
+
+  spin_unlock_irqrestore(&ht->resize_lock, rflags);
+}
+
+void *dts_chashtable_insert(
+    dts_chashtable *ht, void const *key, void const *obj
+) {
+  return dts_chashtable_insert_extra(ht, key, obj, ht->objsize);
+}
+void *dts_chashtable_insert_extra(
+    dts_chashtable *ht, void const *key, void const *obj, size_t objsize
+) {
+  dts_chashtable_node *newnode = kmem_cache_alloc(node_cache);
+  if (!newnode) {
+    return 0;
+  }
+
+  if (ht->keylen) {
+    size_t keylen = ht->keylen(key);
+    newnode->key  = calloc(1, keylen + 1);
+    if (!newnode->key) {
+      kmem_cache_free(node_cache, newnode);
+      return 0;
+    }
+    memcpy(newnode->key, key, keylen);
+  } else {
+    newnode->key = (void *)key;
+  }
+
+  if (objsize) {
+    newnode->obj = calloc(1, objsize);
+    if (!newnode->obj) {
+      if (ht->keylen) {
+        free(newnode->key);
+      }
+      kmem_cache_free(node_cache, newnode);
+      return 0;
+    }
+    memcpy(newnode->obj, obj, objsize);
+  } else {
+    newnode->obj = (void *)obj;
+  }
+
+  newnode->objsize = objsize;
+  newnode->own_key = ht->keylen != 0;
+  newnode->own_obj = objsize != 0;
+
+  size_t hash = ht->hash(key);
+
+  // A resize may start between the look at the state and the locking, the
+  // node would then go to a table that is being moved, after its bucket
+  uint64_t               rflags;
+  dts_chashtable_bucket *bucket;
+  while (true) {
+    dts_chashtable_state *state = rcu_dereference(ht->state);
+    bucket                      = table_bucket(state->cur, hash);
+
+    rflags = spin_lock_irqsave(&bucket->lock);
+    if (__atomic_load_n(&ht->state, __ATOMIC_ACQUIRE) == state) {
+      break;
+    }
+    spin_unlock_irqrestore(&bucket->lock, rflags);
+  }
+
+  newnode->next = bucket->head;
+  rcu_assign_pointer(bucket->head, newnode);
+  spin_unlock_irqrestore(&bucket->lock, rflags);
+
+  __sync_fetch_and_add(&ht->count, 1);
+  table_maintain(ht);
+  return newnode->obj;
+}
+
+void *dts_chashtable_search(dts_chashtable *ht, void const *key, bool *found) {
+  size_t               hash = ht->hash(key);
+  dts_chashtable_node *hit  = 0;
+
+  rcu_read_lock();
+  dts_chashtable_state *state = rcu_dereference(ht->state);
+  while (true) {
+    // old goes first, nodes are put in cur before they are taken out of old
+    if (state->old) {
+      hit = bucket_find(ht, table_bucket(state->old, hash), key);
+    }
+    dts_chashtable_node *newer =
+        bucket_find(ht, table_bucket(state->cur, hash), key);
+    if (newer) {
+      hit = newer;
+    }
+
+    // A miss may come from a state replaced since, whose tables are being
+    // moved without us looking at their destination
+    dts_chashtable_state *next = rcu_dereference(ht->state);
+    if (hit || next == state) {
+      break;
+    }
+    state = next;
+  }
+
+  void *obj = hit ? hit->obj : 0;
+  rcu_read_unlock();
+
+  if (found) {
+    *found = hit != 0;
+  }
+  return obj;
+}
+
+// Unlinks the node with key from bucket, with the bucket locked
+static dts_chashtable_node *bucket_unlink(
+    dts_chashtable *ht, dts_chashtable_bucket *bucket, void const *key
+) {
+  dts_chashtable_node **link = &bucket->head;
+  while (*link && ht->keycmp(key, (*link)->key)) {
+    link = &(*link)->next;
+  }
+
+  dts_chashtable_node *node = *link;
+  if (node) {
+    // Readers on the node keep going through its next
+    rcu_assign_pointer(*link, node->next);
+  }
+  return node;
+}
+
+void dts_chashtable_remove(dts_chashtable *ht, void const *key, void *out_obj) {
+  size_t hash = ht->hash(key);
+
+  // Buckets of old are locked before those of cur, like when moving them
+  uint64_t               rflags;
+  dts_chashtable_bucket *old;
+  dts_chashtable_bucket *cur;
+  while (true) {
+    dts_chashtable_state *state = rcu_dereference(ht->state);
+    old = state->old ? table_bucket(state->old, hash) : 0;
+    cur = table_bucket(state->cur, hash);
+
+    rflags = int_save();
+    if (old) {
+      spin_lock(&old->lock);
+    }
+    spin_lock(&cur->lock);
+    if (__atomic_load_n(&ht->state, __ATOMIC_ACQUIRE) == state) {
+      break;
+    }
+    spin_unlock(&cur->lock);
+    if (old) {
+      spin_unlock(&old->lock);
+    }
+    int_restore(rflags);
+  }
+
+  dts_chashtable_node *node = bucket_unlink(ht, cur, key);
+  if (!node && old) {
+    node = bucket_unlink(ht, old, key);
+  }
+
+  spin_unlock(&cur->lock);
+  if (old) {
+    spin_unlock(&old->lock);
+  }
+  int_restore(rflags);
+
+  if (!node) {
+    return;
+  }
+
+  if (out_obj) {
+    if (node->objsize) {
+      memcpy(out_obj, node->obj, node->objsize);
+    } else {
+      *(void **)out_obj = node->obj;
+    }
+  }
+
+  __sync_fetch_and_sub(&ht->count, 1);
+  call_rcu(&node->rcu, node_free);
+  table_maintain(ht);
+}
@@ -1,10 +1,15 @@
+#include <kmem.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <dts/hashtable.h>
 
+// Nodes of all hashtables come from the same object cache
+static kmem_cache *node_cache = 0;
+
 static int uptr_cmp(void const *k1, void const *k2) {
-  return (uintptr_t)k1 - (uintptr_t)k2;
+  // The difference would not fit an int
+  return ((uintptr_t)k1 > (uintptr_t)k2) - ((uintptr_t)k1 < (uintptr_t)k2);
 }
 
 dts_hashtable *dts_hashtable_create_strkey(size_t esize) {
@@ -64,6 +69,7 @@ void dts_hashtable_destroy(
   for (size_t i = 0; i < ht->nbuckets; ++i) {
     dts_hashtable_node *current = ht->buckets[i];
     while (current) {
+      dts_hashtable_node *next = current->next;
       if (destroy_pair) {
         destroy_pair(ht, current->key, current->obj);
       } else {
@@ -74,7 +80,8 @@ void dts_hashtable_destroy(
           free(current->obj);
         }
       }
-      free(current);
+      kmem_cache_free(node_cache, current);
+      current = next;
     }
   }
 
@@ -82,6 +89,42 @@ void dts_hashtable_destroy(
   free(ht);
 }
 
+// Rehashes every node in a new array of nbuckets buckets, the table stays
+// as it is if the array cannot be allocated
+static void hashtable_resize(dts_hashtable *ht, size_t nbuckets) {
+  dts_hashtable_node **buckets = calloc(nbuckets, sizeof(dts_hashtable_node *));
+  if (!buckets) {
+    return;
+  }
+
+  for (size_t i = 0; i < ht->nbuckets; ++i) {
+    // Reversed first, so that the newest nodes end up first again
+    dts_hashtable_node *reversed = 0;
+    dts_hashtable_node *current  = ht->buckets[i];
+    while (current) {
+      dts_hashtable_node *next = current->next;
+      current->next            = reversed;
+      reversed                 = current;
+      current                  = next;
+    }
+
+    while (reversed) {
+      dts_hashtable_node  *next = reversed->next;
+      dts_hashtable_node **bucket =
+          buckets + ht->hash(reversed->key) % nbuckets;
+
+      reversed->next       = *bucket;
+      reversed->next_count = (*bucket) ? (*bucket)->next_count + 1 : 1;
+      *bucket              = reversed;
+      reversed             = next;
+    }
+  }
+
+  free(ht->buckets);
+  ht->buckets  = buckets;
+  ht->nbuckets = nbuckets;
+}
+
 void *dts_hashtable_insert(
     dts_hashtable *ht, void const *key, void const *obj
 ) {
@@ -90,22 +133,33 @@ void *dts_hashtable_insert(
 void *dts_hashtable_insert_extra(
     dts_hashtable *ht, void const *key, void const *obj, size_t objsize
 ) {
+  if (!node_cache) {
+    node_cache = kmem_cache_create(
+        "dts_hashtable_node", sizeof(dts_hashtable_node), 0, 0
+    );
+  }
+
   size_t              hash    = ht->hash(key);
-  dts_hashtable_node *newnode = calloc(1, sizeof(dts_hashtable_node));
+  dts_hashtable_node *newnode = kmem_cache_alloc(node_cache);
   if (!newnode) {
     return 0;
   }
 
   dts_hashtable_node **bucket = ht->buckets + hash % ht->nbuckets;
-
-  // TODO: Check if resizing is needed
+  // Only when the whole table is loaded, keys that all hash the same would
+  // grow it forever
+  if (*bucket && (*bucket)->next_count >= ht->max_collisions &&
+      ht->count >= ht->nbuckets) {
+    hashtable_resize(ht, ht->nbuckets * 2);
+    bucket = ht->buckets + hash % ht->nbuckets;
+  }
 
   newnode->next       = *bucket;
   newnode->next_count = (*bucket) ? (*bucket)->next_count + 1 : 1;
 
   if (ht->keylen) {
     size_t keylen = ht->keylen(key);
-    newnode->key  = calloc(1, keylen);
+    newnode->key  = calloc(1, keylen + 1);  // String keys keep their NUL
     memcpy(newnode->key, key, keylen);
   } else {
     newnode->key = (void *)key;
@@ -121,6 +175,7 @@ void *dts_hashtable_insert_extra(
   newnode->objsize = objsize;
 
   *bucket = newnode;
+  ++ht->count;
   return newnode->obj;
 }
 void *dts_hashtable_search(dts_hashtable *ht, void const *key, bool *found) {
@@ -129,11 +184,11 @@ void *dts_hashtable_search(dts_hashtable *ht, void const *key, bool *found) {
 
   while (current) {
     if (!ht->keycmp(key, current->key)) {
+      if (found) {
+        *found = true;
+      }
       return current->obj;
     }
-    if (found) {
-      *found = true;
-    }
     current = current->next;
   }
   if (found) {
@@ -142,7 +197,40 @@ void *dts_hashtable_search(dts_hashtable *ht, void const *key, bool *found) {
   return 0;
 }
 void dts_hashtable_remove(dts_hashtable *ht, void const *key, void *out_obj) {
-  // TODO
+  size_t               hash = ht->hash(key);
+  dts_hashtable_node **link = ht->buckets + hash % ht->nbuckets;
+
+  // Nodes before the removed one count it in their next_count
+  dts_hashtable_node *current = *link;
+  while (current && ht->keycmp(key, current->key)) {
+    current = current->next;
+  }
+  if (!current) {
+    return;
+  }
+
+  while (*link != current) {
+    --(*link)->next_count;
+    link = &(*link)->next;
+  }
+  *link = current->next;
+  --ht->count;
+
+  if (out_obj) {
+    if (current->objsize) {
+      memcpy(out_obj, current->obj, current->objsize);
+    } else {
+      *(void **)out_obj = current->obj;
+    }
+  }
+
+  if (ht->keylen) {
+    free(current->key);
+  }
+  if (current->objsize) {
+    free(current->obj);
+  }
+  kmem_cache_free(node_cache, current);
 }
 
 size_t dts_hashtable_std_strhash(void const *vkey) {
@@ -159,5 +247,8 @@ size_t dts_hashtable_std_strhash(void const *vkey) {
   return h;
 }
 size_t dts_hashtable_std_uptrhash(void const *key) {
-  return (size_t)key;
+  // Pointers used as keys are usually aligned, their low bits would put
+  // them all in the same few buckets
+  size_t h = (size_t)key * 0x9E3779B97F4A7C15;
+  return h ^ (h >> 32);
 }
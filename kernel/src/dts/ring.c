@@ -0,0 +1,183 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils.h>
+
+#include <dts/ring.h>
+
+static size_t ring_capacity(size_t cap) {
+  size_t pow = 2;
+  while (pow < cap) {
+    pow <<= 1;
+  }
+  return pow;
+}
+
+static inline volatile size_t *ring_slot(dts_ring *ring, size_t pos) {
+  return ring->slots + (pos & ring->mask) * ring->stride;
+}
+
+dts_ring *dts_ring_create(size_t elen, size_t cap) {
+  dts_ring *ring = aligned_alloc(CACHE_LINE_SIZE, sizeof(dts_ring));
+  if (!ring) {
+    return 0;
+  }
+  memset(ring, 0, sizeof(dts_ring));
+
+  cap          = ring_capacity(cap);
+  ring->mask   = cap - 1;
+  ring->elen   = elen;
+  ring->stride = ALIGN_UP(sizeof(size_t) + elen, sizeof(size_t));
+
+  ring->slots = malloc(cap * ring->stride);
+  if (!ring->slots) {
+    free(ring);
+    return 0;
+  }
+
+  // Slot i is ready for the push at position i
+  for (size_t i = 0; i < cap; ++i) {
+    *ring_slot(ring, i) = i;
+  }
+
+  return ring;
+}
+void dts_ring_destroy(dts_ring *ring) {
+  free(ring->slots);
+  free(ring);
+}
+
+bool dts_ring_push(dts_ring *ring, void const *element) {
+  size_t pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+  volatile size_t *slot;
+  while (true) {
+    slot         = ring_slot(ring, pos);
+    intptr_t lap = __atomic_load_n(slot, __ATOMIC_ACQUIRE) - pos;
+
+    if (lap == 0) {
+      // The slot is free for this lap, claim the position
+      if (__atomic_compare_exchange_n(
+              &ring->head, &pos, pos + 1, true, __ATOMIC_RELAXED,
+              __ATOMIC_RELAXED
+          )) {
+        break;
+      }
+    } else if (lap < 0) {
+      // Still holds the element pushed a lap ago
+      return false;
+    } else {
+      // Another producer took the position
+      pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    }
+  }
+
+  memcpy((void *)(slot + 1), element, ring->elen);
+  __atomic_store_n(slot, pos + 1, __ATOMIC_RELEASE);
+  return true;
+}
+bool dts_ring_pop(dts_ring *ring, void *out_element) {
+  size_t pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+  volatile size_t *slot;
+  while (true) {
+    slot         = ring_slot(ring, pos);
+    intptr_t lap = __atomic_load_n(slot, __ATOMIC_ACQUIRE) - (pos + 1);
+
+    if (lap == 0) {
+      if (__atomic_compare_exchange_n(
+              &ring->tail, &pos, pos + 1, true, __ATOMIC_RELAXED,
+              __ATOMIC_RELAXED
+          )) {
+        break;
+      }
+    } else if (lap < 0) {
+      // Nothing pushed there yet
+      return false;
+    } else {
+      pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    }
+  }
+
+  if (out_element) {
+    memcpy(out_element, (void *)(slot + 1), ring->elen);
+  }
+  // Free the slot for the push one lap ahead
+  __atomic_store_n(slot, pos + ring->mask + 1, __ATOMIC_RELEASE);
+  return true;
+}
+bool dts_ring_pop_single(dts_ring *ring, void *out_element) {
+  size_t           pos  = ring->tail;
+  volatile size_t *slot = ring_slot(ring, pos);
+
+  if (__atomic_load_n(slot, __ATOMIC_ACQUIRE) != pos + 1) {
+    return false;
+  }
+
+  if (out_element) {
+    memcpy(out_element, (void *)(slot + 1), ring->elen);
+  }
+  __atomic_store_n(slot, pos + ring->mask + 1, __ATOMIC_RELEASE);
+  ring->tail = pos + 1;
+  return true;
+}
+
+dts_spsc_ring *dts_spsc_ring_create(size_t elen, size_t cap) {
+  dts_spsc_ring *ring = aligned_alloc(CACHE_LINE_SIZE, sizeof(dts_spsc_ring));
+  if (!ring) {
+    return 0;
+  }
+  memset(ring, 0, sizeof(dts_spsc_ring));
+
+  cap        = ring_capacity(cap);
+  ring->mask = cap - 1;
+  ring->elen = elen;
+
+  ring->elements = calloc(cap, elen);
+  if (!ring->elements) {
+    free(ring);
+    return 0;
+  }
+
+  return ring;
+}
+void dts_spsc_ring_destroy(dts_spsc_ring *ring) {
+  free(ring->elements);
+  free(ring);
+}
+
+bool dts_spsc_ring_push(dts_spsc_ring *ring, void const *element) {
+  size_t head = ring->head;
+
+  if (head - ring->tail_cache > ring->mask) {
+    ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (head - ring->tail_cache > ring->mask) {
+      return false;
+    }
+  }
+
+  memcpy(
+      ring->elements + (head & ring->mask) * ring->elen, element, ring->elen
+  );
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+bool dts_spsc_ring_pop(dts_spsc_ring *ring, void *out_element) {
+  size_t tail = ring->tail;
+
+  if (tail == ring->head_cache) {
+    ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (tail == ring->head_cache) {
+      return false;
+    }
+  }
+
+  if (out_element) {
+    memcpy(
+        out_element, ring->elements + (tail & ring->mask) * ring->elen,
+        ring->elen
+    );
+  }
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+  return true;
+}
@@ -7,6 +7,12 @@ bool env_isvm() {
   return c & (1 << 31);
 }
 
+bool env_hasmwait() {
+  uint32_t a, b, c, d;
+  __cpuid(1, a, b, c, d);
+  return c & (1 << 3);
+}
+
 uint32_t env_busfreq() {
   if (env_isvm()) {
     // If running in a VM, will just set bus frequency to 100MHz, accuracy
@@ -17,3 +23,54 @@ uint32_t env_busfreq() {
   __cpuid(0x16, a, b, c, d);
   return c;
 }
+
+bool env_hasinvtsc() {
+  uint32_t a, b, c, d;
+  if (__get_cpuid_max(0x80000000, 0) < 0x80000007) {
+    return false;
+  }
+  __cpuid(0x80000007, a, b, c, d);
+  return d & (1 << 8);
+}
+
+bool env_hasrdtscp() {
+  uint32_t a, b, c, d;
+  if (__get_cpuid_max(0x80000000, 0) < 0x80000001) {
+    return false;
+  }
+  __cpuid(0x80000001, a, b, c, d);
+  return d & (1 << 27);
+}
+
+bool env_hastscadjust() {
+  uint32_t a, b, c, d;
+  if (__get_cpuid_max(0, 0) < 7) {
+    return false;
+  }
+  __cpuid_count(7, 0, a, b, c, d);
+  return b & (1 << 1);
+}
+
+uint64_t env_tschz() {
+  uint32_t a, b, c, d;
+
+  // TSC to crystal ratio, only usable if the crystal frequency is given
+  if (__get_cpuid_max(0, 0) >= 0x15) {
+    __cpuid(0x15, a, b, c, d);
+    if (a && b && c) {
+      return (uint64_t)c * b / a;
+    }
+  }
+
+  // Timing leaf of KVM and VMware, in kHz
+  if (env_isvm()) {
+    __cpuid(0x40000000, a, b, c, d);
+    if (a >= 0x40000010) {
+      __cpuid(0x40000010, a, b, c, d);
+      if (a) {
+        return (uint64_t)a * 1000;
+      }
+    }
+  }
+  return 0;
+}
@@ -2,6 +2,7 @@
 #include <apic.h>
 #include <boot_info.h>
 #include <cfgtb.h>
+#include <clock.h>
 #include <dev.h>
 #include <initrd.h>
 #include <interrupts.h>
@@ -19,6 +20,7 @@ void __init_stdlib();
 
 void _start() {
   int_disable();
+  proc_early_init();
   {
     // stop all secondary cores
     // they should wait to be started by Helium
@@ -53,5 +55,8 @@ void _start() {
 
   dev_init();
 
+  printd("Calibrating the clock\n");
+  clock_init();
+
   proc_ignite();
 }
\ No newline at end of file
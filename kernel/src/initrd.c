@@ -1,3 +1,4 @@
+#include <arena.h>
 #include <boot_info.h>
 #include <initrd.h>
 #include <mem.h>
@@ -7,16 +8,30 @@
 #include <tar.h>
 #include <utils.h>
 
-#include <dts/hashtable.h>
+#include <dts/chashtable.h>
 
-static dts_hashtable *initrd_nodes;
+// Filled once at boot, searched by any processor without locking
+static dts_chashtable *initrd_nodes;
+
+// Everything describing the initrd lives as long as the kernel
+static arena *initrd_arena;
 
 void initrd_init() {
   mem_vmap(
       INITRD_VPTR, (void *)bootboot.initrd_ptr, bootboot.initrd_size, MAPF_R
   );
 
-  initrd_nodes = dts_hashtable_create_strkey(0);
+  // Paths are in the arena already, the hashtable does not need its own
+  // copy of them
+  initrd_arena = arena_create(0);
+  initrd_nodes = dts_chashtable_create(
+      0,
+      DTS_CHASHTABLE_MAX_LOAD,
+      DTS_CHASHTABLE_INIT_BUCKETS,
+      (dts_keycmp_f)strcmp,
+      NULL,
+      dts_hashtable_std_strhash
+  );
 
   tar_header *current_header = INITRD_VPTR;
   // FIXME: Assumes that directories always come before files
@@ -46,10 +61,11 @@ void initrd_init() {
     }
 
     size_t filename_cap = name_len + namepref_len + 2;
-    char  *filename     = calloc(1, filename_cap);
+    char  *filename     = arena_alloc(initrd_arena, filename_cap);
     snprintf(filename, filename_cap, "/%s%s", ch->name_pref, ch->name);
 
-    initrd_file *file = calloc(1, sizeof(initrd_file));
+    initrd_file *file = arena_alloc(initrd_arena, sizeof(*file));
+    memset(file, 0, sizeof(*file));
     file->path        = filename;
     file->size        = filesize;
     file->type        = ch->type;
@@ -58,9 +74,9 @@ void initrd_init() {
       file->content = ch + 1;
     }
     printd("INITRD: '%s'\n", file->path);
-    dts_hashtable_insert(initrd_nodes, file->path, file);
+    dts_chashtable_insert(initrd_nodes, file->path, file);
   }
 }
 initrd_file *initrd_search(char const *path) {
-  return dts_hashtable_search(initrd_nodes, path, 0);
+  return dts_chashtable_search(initrd_nodes, path, 0);
 }
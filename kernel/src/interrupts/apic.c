@@ -2,11 +2,13 @@
 #include <boot_info.h>
 #include <cpuid.h>
 #include <interrupts.h>
+#include <kmem.h>
+#include <lock.h>
 #include <mem.h>
-#include <mutex.h>
 #include <proc.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys.h>
 #include <vcache.h>
 
 #include <asm/ctlr.h>
@@ -14,7 +16,7 @@
 #include <dts/hashtable.h>
 #include <dts/stack.h>
 
-mutex apic_init_lock;
+static spinlock apic_init_lock = {0};
 
 // This function must be executed by all cores at the same time
 // AP cores will wait for BSP to map a region of memory before they actually
@@ -33,9 +35,9 @@ void apic_init() {
   } else {
     mem_vmap(APIC_VBASE, APIC_BASE, 0x1000, 0);
   }
-  mutex_lock(&apic_init_lock);
+  spin_lock(&apic_init_lock);
 
-  // Setup timer
+  // Setup error and spurious vectors, the timer is left to timer_init()
   {
     lvt_error err = {.reg = 0};
     err.vector    = 0xFD;
@@ -47,19 +49,38 @@ void apic_init() {
     siv.vector      = 0xFF;
 
     APIC_VBASE->sivreg[0] = siv.reg;
+  }
+
+  spin_unlock(&apic_init_lock);
+}
 
-    uint32_t bus_freq = proc_bus_freq();
+void apic_timer_set(uint32_t mode, uint32_t count) {
+  lvt_timer timer = {.reg = 0};
+  timer.vector    = APIC_TIMER_VECTOR;
+  timer.mode      = mode;
 
-    lvt_timer timer = {.reg = 0};
-    timer.vector    = 0xF0;
-    timer.mode      = 0b01;
+  // Writing the initial count (re)starts the timer
+  APIC_VBASE->lvt_timerreg[0] = timer.reg;
+  APIC_VBASE->divcfgreg[0]    = TIMER_DIVCFG(0b111);
+  APIC_VBASE->initcountreg[0] = count;
+}
+
+uint32_t apic_timer_count() {
+  return APIC_VBASE->currcountreg[0];
+}
 
-    APIC_VBASE->lvt_timerreg[0] = timer.reg;
-    APIC_VBASE->divcfgreg[0]    = TIMER_DIVCFG(0b111);
-    APIC_VBASE->initcountreg[0] = bus_freq * 1000;
+void apic_send_ipi(uint32_t apic_id, uint8_t vector) {
+  // Fixed delivery, physical destination, asserted, no shorthand. The ICR
+  // is written in two halves, nothing else may send in between
+  uint64_t rflags = int_save();
+
+  while (APIC_VBASE->icr[0][0] & (1 << 12)) {
+    pause();
   }
+  APIC_VBASE->icr[1][0] = apic_id << 24;
+  APIC_VBASE->icr[0][0] = vector | (1 << 14);
 
-  mutex_ulock(&apic_init_lock);
+  int_restore(rflags);
 }
 
 uint32_t apic_getid() {
@@ -82,8 +103,12 @@ uint32_t ioapic_read(ioapic_regmap *apic_base, uint8_t offset) {
   return apic_base->regwin;
 }
 
+// Created along the first IOAPIC, ioapic_list_lock protects them
+static kmem_cache    *ioapic_cache             = 0;
 static dts_stack     *ioapic_stack             = 0;
+static spinlock       ioapic_list_lock         = {0};
 static dts_hashtable *ioapic_redirection_table = 0;
+static rwlock         ioapic_redirection_lock  = {0};
 
 static void ioapic_register(uint32_t id, void *phyadr, uint32_t int_base) {
   static size_t  pgindex = 0;
@@ -93,37 +118,47 @@ static void ioapic_register(uint32_t id, void *phyadr, uint32_t int_base) {
 
   uint32_t maxredent = ((ioapic_read(vbase, 1) >> 16) & 0b11111111);
 
-  ioapic_info *info = calloc(1, sizeof(ioapic_info));
+  spin_lock(&ioapic_list_lock);
+  if (!ioapic_cache) {
+    ioapic_cache = kmem_cache_create("ioapic_info", sizeof(ioapic_info), 0, 0);
+  }
+  if (!ioapic_stack) {
+    ioapic_stack = dts_stack_create(sizeof(void *), 0);
+  }
+
+  ioapic_info *info = kmem_cache_alloc(ioapic_cache);
   info->id          = id;
   info->irq_base    = int_base;
   info->len         = maxredent + 1;
   info->regmap      = vbase;
 
-  if (!ioapic_stack) {
-    ioapic_stack = dts_stack_create(sizeof(void *), 0);
-  }
-
   dts_stack_push(ioapic_stack, &info);
+  spin_unlock(&ioapic_list_lock);
 }
 
 static void ioapic_redirection(size_t irq_src, size_t irq) {
+  rw_write_lock(&ioapic_redirection_lock);
+
   if (!ioapic_redirection_table) {
     ioapic_redirection_table = dts_hashtable_create_uptrkey(0);
   }
 
   dts_hashtable_insert(ioapic_redirection_table, (void *)irq_src, (void *)irq);
+
+  rw_write_unlock(&ioapic_redirection_lock);
 }
 
 size_t ioapic_find_redirection(size_t irq) {
-  bool found = false;
+  bool   found          = false;
+  size_t redirected_irq = 0;
 
-  // clang-format off
-  // fsr clang-format screws this line up
-  size_t redirected_irq = (size_t)
-    dts_hashtable_search(
+  size_t slot = rw_read_lock(&ioapic_redirection_lock);
+  if (ioapic_redirection_table) {
+    redirected_irq = (size_t)dts_hashtable_search(
         ioapic_redirection_table, (void *)irq, &found
     );
-  // clang-format on
+  }
+  rw_read_unlock(&ioapic_redirection_lock, slot);
 
   if (!found) {
     return irq;
@@ -174,26 +209,21 @@ void apic_acpi_entry_handler(acpi_header *head) {
         if (!lapic->flags) {
           break;
         }
-        proc_info *info = calloc(1, sizeof(proc_info));
+        if (lapic->apic_id != bootboot.bspid && sysid >= PROC_MAX_COUNT) {
+          printd("\tIgnoring processor(apicid=%u)\n", lapic->apic_id);
+          break;
+        }
+        proc_info *info = proc_create_info();
         info->apicid    = lapic->apic_id;
         info->sysid     = lapic->apic_id == bootboot.bspid ? 0 : sysid++;
 
-        info->nmi_stack = mem_alloc_vblock(
-                              NMI_STACK_SIZE,
-                              MAPF_R | MAPF_W,
-                              PROC_TABLE_VPTR,
-                              PROC_TABLE_VSIZE
-                          )
-                              .ptr +
-                          NMI_STACK_SIZE;
-        info->df_stack = mem_alloc_vblock(
-                             DF_STACK_SIZE,
-                             MAPF_R | MAPF_W,
-                             PROC_TABLE_VPTR,
-                             PROC_TABLE_VSIZE
-                         )
-                             .ptr +
-                         DF_STACK_SIZE;
+        void *nmi_stack = aligned_alloc(MEM_PS, NMI_STACK_SIZE);
+        void *df_stack  = aligned_alloc(MEM_PS, DF_STACK_SIZE);
+        if (!nmi_stack || !df_stack) {
+          error_out_of_memory("Could not allocate NMI and DF stacks");
+        }
+        info->nmi_stack = nmi_stack + NMI_STACK_SIZE;
+        info->df_stack  = df_stack + DF_STACK_SIZE;
         // Other fields are set by the processor itself after ignition
 
         proc_register(lapic->apic_id, info);
@@ -14,6 +14,8 @@ void exception_double_fault(int_frame *frame, uint64_t ec);
 
 void apic_err(int_frame *frame);
 void timer_tick(int_frame *frame);
+void apic_kick(int_frame *frame);
+void smp_call_int(int_frame *frame);
 void spurious_int(int_frame *frame);
 
 void ps2_kbd_int(int_frame *frame);
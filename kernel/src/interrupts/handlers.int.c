@@ -1,10 +1,15 @@
 #include <apic.h>
+#include <clock.h>
 #include <interrupts.h>
 #include <kterm.h>
 #include <mutex.h>
 #include <proc.h>
+#include <rcu.h>
+#include <sched.h>
+#include <smp.h>
 #include <stdio.h>
 #include <sys.h>
+#include <timer.h>
 #include <userspace.h>
 #include <utils.h>
 
@@ -15,11 +20,14 @@
 interrupt_handler void nmi_handler(int_frame *frame) {
   // Runs on NMI specific stack
   int_disable();
+  int_swapgs(frame);
   printd("Received NMI\n");
   stop();
 }
 
 static void exception_common_prologue(int_frame *frame, char *name) {
+  // Exceptions are fatal, GS is never swapped back
+  int_swapgs(frame);
   printd("[Proc %&] [EXCEPTION:%s]\n", name);
   printd(
       "IP: %016lx\n"
@@ -36,6 +44,7 @@ static void exception_common_prologue(int_frame *frame, char *name) {
 }
 
 interrupt_handler void inter_unmapped(int_frame *frame) {
+  int_swapgs(frame);
   printd("[Proc %&] Received unmapped interrupt\n");
   stop();
 }
@@ -122,27 +131,61 @@ interrupt_handler void exception_double_fault(int_frame *frame, uint64_t ec) {
 }
 
 interrupt_handler void apic_err(int_frame *frame) {
+  int_swapgs(frame);
   printf("[Proc %&] APIC Error\n");
   stop();
 }
 
 interrupt_handler void timer_tick(int_frame *frame) {
+  bool user = frame->cs & 3;
+  int_swapgs(frame);
+
+  // Interrupting user mode is an RCU quiescent state
+  if (user) {
+    rcu_quiescent();
+  }
+
   if (proc_isprimary()) {
+    clock_tick();
     kterm_flush();
   }
 
   int_disable();
   apic_eoi();
 
-  static bool execed = false;
-  if (proc_isprimary() && !execed) {
-    printd("exec()\n");
-    execed = true;
-    exec();
+  timer_interrupt();
+
+  // Only tasks in user mode are preempted, their FPU state is live, and the
+  // next task may use it in the kernel. The task resumes here, wherever it
+  // is scheduled again
+  if (sched_tick(user)) {
+    task *cur = sched_current();
+    asm volatile("fxsave64 %0" : "=m"(cur->fpu));
+    sched_yield();
+    asm volatile("fxrstor64 %0" ::"m"(cur->fpu));
   }
+
+  // Maybe on another processor, its GS base is the one swapped out
+  int_swapgs(frame);
+}
+
+interrupt_handler void apic_kick(int_frame *frame) {
+  // Only there to get an idle processor out of hlt
+  apic_eoi();
+}
+
+interrupt_handler void smp_call_int(int_frame *frame) {
+  // Calls queued after the queue is taken send another interrupt, which is
+  // why it is acknowledged first
+  int_swapgs(frame);
+  apic_eoi();
+  smp_call_interrupt();
+  int_swapgs(frame);
 }
 
 interrupt_handler void spurious_int(int_frame *frame) {
+  int_swapgs(frame);
   printf("Spurious\n");
   apic_eoi();
+  int_swapgs(frame);
 }
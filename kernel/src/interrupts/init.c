@@ -1,3 +1,4 @@
+#include <apic.h>
 #include <error.h>
 #include <interrupts.h>
 #include <mem.h>
@@ -52,10 +53,18 @@ static idt_entry_info kernel_idt_image[256] = {
         {
            .handler = apic_err,
            },
-    [0xF0] =
+    [APIC_TIMER_VECTOR] =
         {
            .handler = timer_tick,
            },
+    [APIC_KICK_VECTOR] =
+        {
+           .handler = apic_kick,
+           },
+    [APIC_CALL_VECTOR] =
+        {
+           .handler = smp_call_int,
+           },
     [0xFF] =
         {
            .handler = spurious_int,
@@ -1,6 +1,7 @@
 #include <boot_info.h>
 #include <initrd.h>
 #include <kterm.h>
+#include <lock.h>
 #include <psf.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -9,6 +10,7 @@
 #include <string.h>
 #include <sys.h>
 #include <utils.h>
+#include <wait.h>
 
 typedef struct FB_SPEC fb_spec;
 struct FB_SPEC {
@@ -73,6 +75,10 @@ typedef struct INPUTBUF {
 static term_state state;
 static inputbuf   buffer;
 
+// The input buffer is filled by the keyboard interrupt, readers wait for it
+static spinlock   input_lock = {0};
+static wait_queue input_wait = {0};
+
 static uint32_t getcolor(
     uint8_t format, uint8_t r, uint8_t g, uint8_t b, uint8_t a
 ) {
@@ -320,12 +326,19 @@ size_t kterm_read(char *restrict str, size_t n) {
     return 0;
   }
 
-  size_t read_amount = buffer.len > n ? n : buffer.len;
+  // Sleeps until there is at least a character to read
+  wait_event(&input_wait, buffer.len);
+
+  uint64_t rflags      = spin_lock_irqsave(&input_lock);
+  size_t   read_amount = buffer.len > n ? n : buffer.len;
   extract_buffer(str, read_amount);
+  spin_unlock_irqrestore(&input_lock, rflags);
+
   return read_amount;
 }
 
 void kterm_putcin(char c) {
+  uint64_t rflags = spin_lock_irqsave(&input_lock);
   if (buffer.len + 1 > buffer.cap) {
     size_t newcap =
         buffer.cap * 2 < buffer.len + 1 ? buffer.len + 4 : buffer.cap * 2;
@@ -334,12 +347,16 @@ void kterm_putcin(char c) {
   }
   buffer.buf[buffer.len] = c;
   buffer.len++;
+  spin_unlock_irqrestore(&input_lock, rflags);
+
+  wake_up_all(&input_wait);
   if (state.echo) {
     putchar(c);
   }
 }
 void kterm_putsin(char const *str) {
-  size_t len = strlen(str);
+  size_t   len    = strlen(str);
+  uint64_t rflags = spin_lock_irqsave(&input_lock);
   if (buffer.len + len > buffer.cap) {
     size_t newcap = buffer.cap * 2 < buffer.len + len ? buffer.len + len + 4
                                                       : buffer.cap * 2;
@@ -348,6 +365,9 @@ void kterm_putsin(char const *str) {
   }
   memcpy(buffer.buf + buffer.len, str, len);
   buffer.len += len;
+  spin_unlock_irqrestore(&input_lock, rflags);
+
+  wake_up_all(&input_wait);
   if (state.echo) {
     puts(str);
   }
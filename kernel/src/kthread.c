@@ -0,0 +1,123 @@
+#include <kthread.h>
+#include <proc.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys.h>
+
+static void kthread_put(kthread *kt) {
+  if (!__sync_sub_and_fetch(&kt->refs, 1)) {
+    free(kt);
+  }
+}
+
+static void kthread_entry(void *arg) {
+  kthread *kt = arg;
+  kthread_exit(kt->fn(kt->arg));
+}
+
+static kthread *kthread_alloc(kthread_f fn, void *arg) {
+  kthread *kt = malloc(sizeof(*kt));
+  if (!kt) {
+    return 0;
+  }
+  memset(kt, 0, sizeof(*kt));
+  kt->fn   = fn;
+  kt->arg  = arg;
+  kt->refs = 2;
+
+  kt->task = task_create(kthread_entry, kt);
+  if (!kt->task) {
+    free(kt);
+    return 0;
+  }
+  return kt;
+}
+
+kthread *kthread_create(kthread_f fn, void *arg) {
+  kthread *kt = kthread_alloc(fn, arg);
+  if (kt) {
+    sched_add(kt->task);
+  }
+  return kt;
+}
+
+kthread *kthread_create_on(kthread_f fn, void *arg, size_t sysid) {
+  kthread *kt = kthread_alloc(fn, arg);
+  if (kt) {
+    sched_add_on(kt->task, sysid);
+  }
+  return kt;
+}
+
+noreturn void kthread_exit(void *ret) {
+  kthread *kt = sched_current()->arg;
+
+  kt->ret    = ret;
+  kt->exited = true;
+  wake_up_all(&kt->exit_wait);
+
+  // The task itself is freed by the scheduler once switched out
+  kthread_put(kt);
+  sched_exit();
+}
+
+void *kthread_join(kthread *kt) {
+  wait_event(&kt->exit_wait, kt->exited);
+
+  void *ret = kt->ret;
+  kthread_put(kt);
+  return ret;
+}
+
+void kthread_detach(kthread *kt) {
+  kthread_put(kt);
+}
+
+// Start of the first thread to run, end of the last one to finish
+static volatile uint64_t bench_start = 0;
+static volatile uint64_t bench_end   = 0;
+
+static void *bench_entry(void *arg) {
+  __sync_val_compare_and_swap(&bench_start, 0, rdtsc());
+
+  // The other thread is the only other task pending on this processor, so
+  // every yield is a switch to it
+  for (size_t i = 0; i < KTHREAD_BENCH_ROUNDS; ++i) {
+    sched_yield();
+  }
+
+  bench_end = rdtsc();
+  return 0;
+}
+
+void kthread_bench() {
+  size_t sysid = proc_sysid();
+
+  bench_start = 0;
+  bench_end   = 0;
+
+  kthread *a = kthread_create_on(bench_entry, 0, sysid);
+  kthread *b = kthread_create_on(bench_entry, 0, sysid);
+  if (!a || !b) {
+    printd("kthread_bench: out of memory\n");
+    if (a) {
+      kthread_join(a);
+    }
+    if (b) {
+      kthread_join(b);
+    }
+    return;
+  }
+  kthread_join(a);
+  kthread_join(b);
+
+  uint64_t cycles = bench_end - bench_start;
+  printd(
+      "[Proc %&] Context switch: %lu cycles (%lu switches in %lu cycles)\n",
+      cycles / (2 * KTHREAD_BENCH_ROUNDS),
+      2 * KTHREAD_BENCH_ROUNDS,
+      cycles
+  );
+}
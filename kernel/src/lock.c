@@ -0,0 +1,211 @@
+#include <interrupts.h>
+#include <lock.h>
+#include <smp.h>
+#include <sys.h>
+
+// Where the lock function was called from
+#define LOCK_SITE() __builtin_return_address(0)
+
+// Every wait on a lock goes through here. With interrupts disabled, the
+// holder may be waiting for this processor to run its cross processor call
+static inline void lock_relax() {
+  smp_call_poll();
+  pause();
+}
+
+// Returns the cycles spent spinning when profiling, 0 otherwise
+static inline uint64_t spin_acquire(spinlock *lock) {
+  uint32_t ticket = __sync_fetch_and_add(&lock->next, 1);
+  if (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) == ticket) {
+    return 0;
+  }
+
+  uint64_t start = lock_stat_clock();
+  while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+    lock_relax();
+  }
+  return lock_stat_clock() - start;
+}
+
+void spin_lock(spinlock *lock) {
+  uint64_t spun = spin_acquire(lock);
+  lock_stat_acquired(lock, spun, LOCK_SITE());
+}
+
+bool spin_trylock(spinlock *lock) {
+  // Only take a ticket if it would be served right away
+  uint32_t owner = __atomic_load_n(&lock->owner, __ATOMIC_RELAXED);
+  if (!__sync_bool_compare_and_swap(&lock->next, owner, owner + 1)) {
+    return false;
+  }
+  lock_stat_acquired(lock, 0, LOCK_SITE());
+  return true;
+}
+
+void spin_unlock(spinlock *lock) {
+  // Only the holder ever writes owner
+  __atomic_store_n(&lock->owner, lock->owner + 1, __ATOMIC_RELEASE);
+}
+
+uint64_t spin_lock_irqsave(spinlock *lock) {
+  uint64_t rflags = int_save();
+  uint64_t spun   = spin_acquire(lock);
+  lock_stat_acquired(lock, spun, LOCK_SITE());
+  return rflags;
+}
+
+void spin_unlock_irqrestore(spinlock *lock, uint64_t rflags) {
+  spin_unlock(lock);
+  int_restore(rflags);
+}
+
+// Returns the cycles spent spinning when profiling, 0 otherwise
+static inline uint64_t mcs_enqueue(mcs_lock *lock, mcs_node *node) {
+  node->next   = 0;
+  node->locked = true;
+
+  mcs_node *prev = __sync_lock_test_and_set(&lock->tail, node);
+  if (!prev) {
+    return 0;
+  }
+
+  // Queue behind the previous waiter, it hands the lock over by clearing
+  // our locked flag
+  uint64_t start = lock_stat_clock();
+  __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+  while (__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE)) {
+    lock_relax();
+  }
+  return lock_stat_clock() - start;
+}
+
+void mcs_acquire(mcs_lock *lock, mcs_node *node) {
+  uint64_t spun = mcs_enqueue(lock, node);
+  lock_stat_acquired(lock, spun, LOCK_SITE());
+}
+
+void mcs_release(mcs_lock *lock, mcs_node *node) {
+  mcs_node *next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+
+  if (!next) {
+    // No one queued, unless someone is between swapping the tail and
+    // linking themselves behind us
+    if (__sync_bool_compare_and_swap(&lock->tail, node, 0)) {
+      return;
+    }
+    while (!(next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE))) {
+      pause();
+    }
+  }
+
+  __atomic_store_n(&next->locked, false, __ATOMIC_RELEASE);
+}
+
+uint64_t mcs_acquire_irqsave(mcs_lock *lock, mcs_node *node) {
+  uint64_t rflags = int_save();
+  uint64_t spun   = mcs_enqueue(lock, node);
+  lock_stat_acquired(lock, spun, LOCK_SITE());
+  return rflags;
+}
+
+void mcs_release_irqrestore(mcs_lock *lock, mcs_node *node, uint64_t rflags) {
+  mcs_release(lock, node);
+  int_restore(rflags);
+}
+
+size_t rw_read_lock(rwlock *lock) {
+  size_t             slot  = proc_sysid();
+  volatile uint32_t *count = &lock->readers[slot].count;
+
+  while (true) {
+    // Interrupts are off between the add and the sub, so a count found in
+    // the slot is always a reader holding the lock, never one backing off
+    uint64_t rflags = int_save();
+
+    // The locked add orders the count before the look at the flag, the
+    // writer does the opposite. A reader already counted in the slot holds
+    // the writer back, a nested reader goes in even if the flag is up
+    if (__sync_fetch_and_add(count, 1) ||
+        !__atomic_load_n(&lock->writing, __ATOMIC_ACQUIRE)) {
+      int_restore(rflags);
+      return slot;
+    }
+
+    __sync_fetch_and_sub(count, 1);
+    int_restore(rflags);
+    while (__atomic_load_n(&lock->writing, __ATOMIC_RELAXED)) {
+      lock_relax();
+    }
+  }
+}
+
+void rw_read_unlock(rwlock *lock, size_t slot) {
+  __sync_fetch_and_sub(&lock->readers[slot].count, 1);
+}
+
+// Returns the cycles spent waiting for other writers and for the readers
+// when profiling, 0 otherwise
+static inline uint64_t rw_acquire(rwlock *lock) {
+  uint64_t spun = spin_acquire(&lock->writer);
+  __atomic_store_n(&lock->writing, true, __ATOMIC_SEQ_CST);
+
+  uint64_t start = lock_stat_clock();
+  bool     drain = false;
+  for (size_t i = 0; i < PROC_MAX_COUNT; ++i) {
+    while (__atomic_load_n(&lock->readers[i].count, __ATOMIC_ACQUIRE)) {
+      drain = true;
+      lock_relax();
+    }
+  }
+  return drain ? spun + lock_stat_clock() - start : spun;
+}
+
+void rw_write_lock(rwlock *lock) {
+  uint64_t spun = rw_acquire(lock);
+  lock_stat_acquired(lock, spun, LOCK_SITE());
+}
+
+void rw_write_unlock(rwlock *lock) {
+  __atomic_store_n(&lock->writing, false, __ATOMIC_RELEASE);
+  spin_unlock(&lock->writer);
+}
+
+uint64_t rw_write_lock_irqsave(rwlock *lock) {
+  uint64_t rflags = int_save();
+  uint64_t spun   = rw_acquire(lock);
+  lock_stat_acquired(lock, spun, LOCK_SITE());
+  return rflags;
+}
+
+void rw_write_unlock_irqrestore(rwlock *lock, uint64_t rflags) {
+  rw_write_unlock(lock);
+  int_restore(rflags);
+}
+
+uint32_t seq_read_begin(seqlock *lock) {
+  uint32_t seq;
+  while ((seq = __atomic_load_n(&lock->seq, __ATOMIC_ACQUIRE)) & 1) {
+    lock_relax();
+  }
+  return seq;
+}
+
+bool seq_read_retry(seqlock *lock, uint32_t start) {
+  // The copy has to be done before the sequence is read again
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&lock->seq, __ATOMIC_RELAXED) != start;
+}
+
+uint64_t seq_write_lock(seqlock *lock) {
+  uint64_t rflags = int_save();
+  uint64_t spun   = spin_acquire(&lock->writer);
+  lock_stat_acquired(lock, spun, LOCK_SITE());
+  __atomic_store_n(&lock->seq, lock->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  return rflags;
+}
+
+void seq_write_unlock(seqlock *lock, uint64_t rflags) {
+  __atomic_store_n(&lock->seq, lock->seq + 1, __ATOMIC_RELEASE);
+  spin_unlock_irqrestore(&lock->writer, rflags);
+}
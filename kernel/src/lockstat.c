@@ -0,0 +1,176 @@
+#ifdef HELIUM_PROFILE_LOCK
+
+#include <lock.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+  The statistics of a lock are only written by whoever holds it, so they
+  need no lock of their own, only claiming a record for a lock seen for the
+  first time is atomic. Dumping reads them while they change, a line may be
+  off by the acquisitions in flight.
+  When a lock has more contending sites than it can keep, the one that
+  waited the least so far makes room, so the heaviest ones stay.
+*/
+
+#define LOCK_STAT_LOCKS (512)
+#define LOCK_STAT_SITES (4)
+
+struct LOCK_STAT_SITE;
+typedef struct LOCK_STAT_SITE lock_stat_site;
+struct LOCK_STAT_SITE {
+  void    *site;
+  uint64_t contended;
+  uint64_t cycles;
+};
+
+struct LOCK_STAT;
+typedef struct LOCK_STAT lock_stat;
+struct LOCK_STAT {
+  void const *volatile lock;
+  char const *name;
+
+  uint64_t acquired;
+  uint64_t contended;
+  uint64_t cycles;
+  uint64_t max_cycles;
+
+  lock_stat_site sites[LOCK_STAT_SITES];
+};
+
+static lock_stat         stats[LOCK_STAT_LOCKS];
+static volatile uint64_t dropped = 0;  // Acquisitions of locks with no record
+
+static size_t hash_ptr(void const *ptr) {
+  return ((uintptr_t)ptr >> 2) * 0x9E3779B97F4A7C15 >> 32;
+}
+
+// Returns the record of the lock, or 0 if the table is full
+static lock_stat *find_stat(void const *lock) {
+  size_t idx = hash_ptr(lock) % LOCK_STAT_LOCKS;
+  for (size_t i = 0; i < LOCK_STAT_LOCKS;
+       ++i, idx = (idx + 1) % LOCK_STAT_LOCKS) {
+    void const *cur = __atomic_load_n(&stats[idx].lock, __ATOMIC_ACQUIRE);
+    if (!cur) {
+      cur = __sync_val_compare_and_swap(&stats[idx].lock, 0, lock);
+    }
+    if (!cur || cur == lock) {
+      return stats + idx;
+    }
+  }
+  return 0;
+}
+
+void lock_stat_acquired(void const *lock, uint64_t spin_cycles, void *site) {
+  lock_stat *stat = find_stat(lock);
+  if (!stat) {
+    __sync_fetch_and_add(&dropped, 1);
+    return;
+  }
+
+  ++stat->acquired;
+  if (!spin_cycles) {
+    return;
+  }
+
+  ++stat->contended;
+  stat->cycles += spin_cycles;
+  if (spin_cycles > stat->max_cycles) {
+    stat->max_cycles = spin_cycles;
+  }
+
+  lock_stat_site *s = stat->sites;
+  for (size_t i = 0; i < LOCK_STAT_SITES; ++i) {
+    if (stat->sites[i].site == site) {
+      s = stat->sites + i;
+      break;
+    }
+    if (stat->sites[i].cycles < s->cycles) {
+      s = stat->sites + i;
+    }
+  }
+
+  if (s->site != site) {
+    s->site      = site;
+    s->contended = 0;
+    s->cycles    = 0;
+  }
+  ++s->contended;
+  s->cycles += spin_cycles;
+}
+
+void lock_stat_name(void const *lock, char const *name) {
+  lock_stat *stat = find_stat(lock);
+  if (stat) {
+    stat->name = name;
+  }
+}
+
+void lock_stat_dump() {
+  static size_t order[LOCK_STAT_LOCKS];
+
+  // Locks are printed by decreasing cycles spent waiting for them
+  size_t count = 0;
+  for (size_t i = 0; i < LOCK_STAT_LOCKS; ++i) {
+    if (!stats[i].acquired) {
+      continue;
+    }
+
+    size_t j = count++;
+    for (; j && stats[order[j - 1]].cycles < stats[i].cycles; --j) {
+      order[j] = order[j - 1];
+    }
+    order[j] = i;
+  }
+
+  printd("Lock profile: %lu locks, %lu acquisitions dropped\n", count, dropped);
+
+  for (size_t i = 0; i < count; ++i) {
+    lock_stat *stat = stats + order[i];
+
+    if (stat->name) {
+      printd("%s (%p)", stat->name, stat->lock);
+    } else {
+      printd("%p", stat->lock);
+    }
+    printd(
+        ": acquired %lu, contended %lu, spun %lu cycles, max %lu, avg %lu\n",
+        stat->acquired,
+        stat->contended,
+        stat->cycles,
+        stat->max_cycles,
+        stat->contended ? stat->cycles / stat->contended : 0
+    );
+
+    for (size_t j = 0; j < LOCK_STAT_SITES; ++j) {
+      lock_stat_site *s = stat->sites + j;
+      if (s->site) {
+        printd(
+            "\t%p: contended %lu, spun %lu\n", s->site, s->contended, s->cycles
+        );
+      }
+    }
+  }
+}
+
+void lock_stat_reset() {
+  // Records are kept, they still belong to the same locks
+  for (size_t i = 0; i < LOCK_STAT_LOCKS; ++i) {
+    lock_stat *stat = stats + i;
+
+    stat->acquired   = 0;
+    stat->contended  = 0;
+    stat->cycles     = 0;
+    stat->max_cycles = 0;
+    memset(stat->sites, 0, sizeof(stat->sites));
+  }
+  dropped = 0;
+}
+
+#else
+
+void lock_stat_dump() {}
+void lock_stat_reset() {}
+
+#endif
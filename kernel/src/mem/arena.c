@@ -0,0 +1,113 @@
+#include <arena.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils.h>
+
+static arena_chunk *alloc_chunk(size_t size) {
+  arena_chunk *chunk = malloc(sizeof(arena_chunk) + size);
+  if (!chunk) {
+    return 0;
+  }
+
+  chunk->next = 0;
+  chunk->size = size;
+  chunk->used = 0;
+  return chunk;
+}
+
+arena *arena_create(size_t chunk_size) {
+  if (chunk_size && chunk_size <= sizeof(arena_chunk)) {
+    return 0;
+  }
+
+  arena *arena = malloc(sizeof(*arena));
+  if (!arena) {
+    return 0;
+  }
+
+  arena->chunk_size = chunk_size ? chunk_size : ARENA_CHUNK_SIZE;
+  arena->chunks     = alloc_chunk(arena->chunk_size - sizeof(arena_chunk));
+  if (!arena->chunks) {
+    free(arena);
+    return 0;
+  }
+
+  return arena;
+}
+
+void arena_destroy(arena *arena) {
+  arena_chunk *chunk = arena->chunks;
+  while (chunk) {
+    arena_chunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+
+  free(arena);
+}
+
+void *arena_alloc(arena *arena, size_t size) {
+  size = ALIGN_UP(size, ARENA_ALIGNMENT);
+
+  arena_chunk *chunk = arena->chunks;
+  if (chunk->size - chunk->used >= size) {
+    void *ptr = (void *)(chunk + 1) + chunk->used;
+    chunk->used += size;
+    return ptr;
+  }
+
+  // Allocations larger than a quarter of a chunk get a chunk of their own,
+  // which goes after the current one so that we keep bumping from it
+  size_t chunk_payload = arena->chunk_size - sizeof(arena_chunk);
+  if (size > chunk_payload / 4) {
+    arena_chunk *big = alloc_chunk(size);
+    if (!big) {
+      return 0;
+    }
+
+    big->used   = size;
+    big->next   = chunk->next;
+    chunk->next = big;
+    return big + 1;
+  }
+
+  arena_chunk *new_chunk = alloc_chunk(chunk_payload);
+  if (!new_chunk) {
+    return 0;
+  }
+
+  new_chunk->used = size;
+  new_chunk->next = chunk;
+  arena->chunks   = new_chunk;
+  return new_chunk + 1;
+}
+
+char *arena_strdup(arena *arena, char const *str) {
+  size_t len = strlen(str) + 1;
+  char  *dup = arena_alloc(arena, len);
+  if (dup) {
+    memcpy(dup, str, len);
+  }
+  return dup;
+}
+
+void arena_reset(arena *arena) {
+  // Keep one chunk of the standard size, free everything else
+  size_t       chunk_payload = arena->chunk_size - sizeof(arena_chunk);
+  arena_chunk *kept          = 0;
+  arena_chunk *chunk         = arena->chunks;
+
+  while (chunk) {
+    arena_chunk *next = chunk->next;
+    if (!kept && chunk->size == chunk_payload) {
+      kept = chunk;
+    } else {
+      free(chunk);
+    }
+    chunk = next;
+  }
+
+  kept->next    = 0;
+  kept->used    = 0;
+  arena->chunks = kept;
+}
@@ -0,0 +1,211 @@
+#include <interrupts.h>
+#include <kmem.h>
+#include <lock.h>
+#include <mem.h>
+#include <stdio.h>
+#include <string.h>
+#include <utils.h>
+
+// Slabs(and the caches themselves) are taken from KSLAB by simply moving
+// this pointer forward, KMEM_SLAB_SIZE aligned
+static void    *slab_brk  = KSLAB;
+static spinlock slab_lock = {0};
+
+static void *slab_vspace(size_t size) {
+  size = ALIGN_UP(size, KMEM_SLAB_SIZE);
+
+  uint64_t rflags = spin_lock_irqsave(&slab_lock);
+  if (slab_brk + size > KSLAB + KSLAB_SIZE) {
+    spin_unlock_irqrestore(&slab_lock, rflags);
+    return 0;
+  }
+  void *ptr = slab_brk;
+  slab_brk += size;
+  spin_unlock_irqrestore(&slab_lock, rflags);
+
+  return mem_alloc_into(ptr, size, MAPF_R | MAPF_W);
+}
+
+kmem_cache *kmem_cache_create(
+    char const *name, size_t size, size_t align, kmem_ctor_f ctor
+) {
+  if (!size || size > KMEM_MAX_OBJSIZE || (align & (align - 1))) {
+    return 0;
+  }
+
+  if (align < CACHE_LINE_SIZE) {
+    align = CACHE_LINE_SIZE;
+  }
+
+  kmem_cache *cache = slab_vspace(sizeof(kmem_cache));
+  if (!cache) {
+    return 0;
+  }
+  memset(cache, 0, sizeof(*cache));
+
+  // Free objects hold the link in their first word, past their end if
+  // they have a constructed state to keep
+  cache->linkoff = 0;
+  if (ctor) {
+    cache->linkoff = ALIGN_UP(size, sizeof(void *));
+    size           = cache->linkoff + sizeof(void *);
+  }
+
+  cache->name     = name;
+  cache->objsize  = ALIGN_UP(size, align);
+  cache->objoff   = ALIGN_UP(sizeof(kmem_slab), align);
+  cache->slab_len = (KMEM_SLAB_SIZE - cache->objoff) / cache->objsize;
+  cache->ctor     = ctor;
+
+  lock_stat_name(&cache->lock, name);
+  return cache;
+}
+
+#define OBJ_LINK(cache, obj) (*(void **)((obj) + (cache)->linkoff))
+
+// Must be called with the cache lock held
+static kmem_slab *slab_grow(kmem_cache *cache) {
+  kmem_slab *slab = slab_vspace(KMEM_SLAB_SIZE);
+  if (!slab) {
+    return 0;
+  }
+
+  slab->cache    = cache;
+  slab->inuse    = 0;
+  slab->freelist = 0;
+
+  // Build the free list backwards so that objects are handed out in
+  // address order
+  for (size_t i = cache->slab_len; i != 0; --i) {
+    void *obj = (void *)slab + cache->objoff + (i - 1) * cache->objsize;
+    if (cache->ctor) {
+      cache->ctor(obj);
+    }
+    OBJ_LINK(cache, obj) = slab->freelist;
+    slab->freelist       = obj;
+  }
+
+  slab->prev = 0;
+  slab->next = cache->partial;
+  if (slab->next) {
+    slab->next->prev = slab;
+  }
+  cache->partial = slab;
+  ++cache->slab_count;
+
+  return slab;
+}
+
+static void slab_unlink(kmem_cache *cache, kmem_slab *slab) {
+  if (slab->prev) {
+    slab->prev->next = slab->next;
+  } else {
+    cache->partial = slab->next;
+  }
+  if (slab->next) {
+    slab->next->prev = slab->prev;
+  }
+  slab->next = 0;
+  slab->prev = 0;
+}
+
+// Fills half the magazine from the slabs
+static void magazine_refill(kmem_cache *cache, kmem_magazine *mag) {
+  spin_lock(&cache->lock);
+  while (mag->len < KMEM_MAGAZINE_LEN / 2 + 1) {
+    kmem_slab *slab = cache->partial;
+    if (!slab && !(slab = slab_grow(cache))) {
+      break;
+    }
+
+    void *obj      = slab->freelist;
+    slab->freelist = OBJ_LINK(cache, obj);
+    ++slab->inuse;
+
+    // Full slabs are not kept in any list, free() will find them again
+    if (!slab->freelist) {
+      slab_unlink(cache, slab);
+    }
+
+    mag->objs[mag->len++] = obj;
+  }
+  spin_unlock(&cache->lock);
+}
+
+// Gives half the magazine back to the slabs
+static void magazine_flush(kmem_cache *cache, kmem_magazine *mag) {
+  spin_lock(&cache->lock);
+  while (mag->len > KMEM_MAGAZINE_LEN / 2) {
+    void      *obj  = mag->objs[--mag->len];
+    kmem_slab *slab = (void *)ALIGN_DN((uintptr_t)obj, KMEM_SLAB_SIZE);
+
+    // The slab was full, it now goes back to the partial list
+    if (!slab->freelist) {
+      slab->prev = 0;
+      slab->next = cache->partial;
+      if (slab->next) {
+        slab->next->prev = slab;
+      }
+      cache->partial = slab;
+    }
+
+    OBJ_LINK(cache, obj) = slab->freelist;
+    slab->freelist       = obj;
+    --slab->inuse;
+  }
+  spin_unlock(&cache->lock);
+}
+
+void *kmem_cache_alloc(kmem_cache *cache) {
+  // The magazine is per processor, only an interrupt on this very processor
+  // could touch it concurrently
+  uint64_t       rflags = int_save();
+  kmem_magazine *mag    = cache->magazines + proc_sysid();
+
+  if (!mag->len) {
+    magazine_refill(cache, mag);
+  }
+
+  void *obj = mag->len ? mag->objs[--mag->len] : 0;
+  int_restore(rflags);
+
+  return obj;
+}
+
+void kmem_cache_free(kmem_cache *cache, void *obj) {
+  if (!obj) {
+    return;
+  }
+
+  kmem_slab *slab = (void *)ALIGN_DN((uintptr_t)obj, KMEM_SLAB_SIZE);
+  if (slab->cache != cache) {
+    printd("kmem_cache_free(): Pointer invalid(cache=%s)\n", cache->name);
+    return;
+  }
+
+  uint64_t       rflags = int_save();
+  kmem_magazine *mag    = cache->magazines + proc_sysid();
+
+  if (mag->len == KMEM_MAGAZINE_LEN) {
+    magazine_flush(cache, mag);
+  }
+
+  mag->objs[mag->len++] = obj;
+  int_restore(rflags);
+}
+
+void kmem_cache_print_state(kmem_cache *cache) {
+  printd(
+      "kmem_cache(name=%s,objsize=%lu,slab_len=%lu,slab_count=%lu)\n",
+      cache->name,
+      cache->objsize,
+      cache->slab_len,
+      cache->slab_count
+  );
+
+  size_t slab_count = 0;
+  for (kmem_slab *slab = cache->partial; slab; slab = slab->next) {
+    printd("\tSlab #%lu [%p] inuse=%lu\n", slab_count, slab, slab->inuse);
+    ++slab_count;
+  }
+}
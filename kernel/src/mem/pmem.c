@@ -1,5 +1,5 @@
+#include <lock.h>
 #include <mem.h>
-#include <mutex.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <utils.h>
@@ -21,7 +21,8 @@
     bugs in the kernel may start appearing(which should be good i guess)
 */
 
-static mutex pmm_lock;
+// Every processor allocates its pages here, so this one is queued
+static mcs_lock pmm_lock;
 
 mem_pallocation mem_ppalloc(
     void *pheader, size_t size, size_t alignment, bool cont, void *below
@@ -58,7 +59,8 @@ mem_pallocation mem_ppalloc(
     return alloc;
   }
 
-  mutex_lock(&pmm_lock);
+  mcs_node node;
+  uint64_t rflags = mcs_acquire_irqsave(&pmm_lock, &node);
 
   size_t alignment_p = alignment / MEM_PS;
 
@@ -108,7 +110,7 @@ mem_pallocation mem_ppalloc(
             // A more efficient way to set bits than
             // the older implementation
             if (lpg_idx - fpg_idx + 1 < 64) {  // only one/two u64 to change
-              if (ALIGN_DN(lpg_idx, 64) != ALIGN_DN(fpg_idx, 64)) {  // one u64
+              if (ALIGN_DN(lpg_idx, 64) == ALIGN_DN(fpg_idx, 64)) {  // one u64
                 bitmap[fpg_idx / 64] |=
                     BITRANGE(fpg_idx % 64, lpg_idx % 64 + 1);
               } else {  // two u64 to change
@@ -131,7 +133,7 @@ mem_pallocation mem_ppalloc(
             alloc.header_off = pmm_header_off;
             alloc.padr       = h->padr + fpg_idx * MEM_PS;
             alloc.size       = pg_count * MEM_PS;
-            mutex_ulock(&pmm_lock);
+            mcs_release_irqrestore(&pmm_lock, &node, rflags);
             prtrace_end(
                 "mem_ppalloc",
                 "SUCCESS",
@@ -175,7 +177,7 @@ mem_pallocation mem_ppalloc(
     pmm_header_off += sizeof(mem_pseg_header) + bitmap_size;
   }
 
-  mutex_ulock(&pmm_lock);
+  mcs_release_irqrestore(&pmm_lock, &node, rflags);
   prtrace_end("mem_ppalloc", "ERR_MEM_NO_PHY_SPACE", 0);
   alloc.error = ERR_MEM_NO_PHY_SPACE;
   return alloc;
@@ -191,26 +193,54 @@ void mem_ppfree(void *pheader, mem_pallocation alloc) {
       alloc.size
   );
 
-  mutex_lock(&pmm_lock);
-  uint64_t *bitmap = (uint64_t *)(alloc.header_off + 1);
-  size_t    fpg_idx =
-      (size_t)(alloc.padr -
-               ((mem_pseg_header *)(pheader + alloc.header_off))->padr) /
-      MEM_PS;
-  size_t pg_count = ALIGN_UP(alloc.size, MEM_PS) / MEM_PS;
-  size_t lpg_idx  = fpg_idx + pg_count - 1;
-  if (fpg_idx - lpg_idx < 64) {  // only one u64 to change
+  if (pheader == PALLOC_STD_HEADER) {
+    pheader = i_pmm_header;
+  }
+
+  mcs_node node;
+  uint64_t rflags = mcs_acquire_irqsave(&pmm_lock, &node);
+
+  mem_pseg_header *h        = pheader + alloc.header_off;
+  uint64_t        *bitmap   = (uint64_t *)(h + 1);
+  size_t           fpg_idx  = (size_t)(alloc.padr - h->padr) / MEM_PS;
+  size_t           pg_count = ALIGN_UP(alloc.size, MEM_PS) / MEM_PS;
+  size_t           lpg_idx  = fpg_idx + pg_count - 1;
+  if (fpg_idx / 64 == lpg_idx / 64) {  // only one u64 to change
     bitmap[fpg_idx / 64] &= ~BITRANGE(fpg_idx % 64, lpg_idx % 64 + 1);
   } else {  // multiple u64s to set
     bitmap[fpg_idx / 64] &= ~BITRANGE(fpg_idx % 64, 64);
     bitmap[lpg_idx / 64] &= ~BITRANGE(0, lpg_idx % 64 + 1);
-    size_t cpg_idx = ALIGN_UP(fpg_idx, 64);
-    while (cpg_idx < lpg_idx + 64) {
-      bitmap[cpg_idx / 64] = 0;
-      cpg_idx += 64;
+    for (size_t i = fpg_idx / 64 + 1; i < lpg_idx / 64; ++i) {
+      bitmap[i] = 0;
     }
   }
-  mutex_ulock(&pmm_lock);
+  mcs_release_irqrestore(&pmm_lock, &node, rflags);
 
   prtrace_end("mem_ppfree", 0, 0);
 }
+
+void mem_ppfree_padr(void *pheader, void *padr, size_t size) {
+  if (pheader == PALLOC_STD_HEADER) {
+    pheader = i_pmm_header;
+  }
+
+  size_t pmm_header_off = 0;
+  for (size_t i = 0; i < i_mmap_usable_len; ++i) {
+    mem_pseg_header *h = pheader + pmm_header_off;
+
+    if (h->padr <= padr && padr < h->padr + h->size) {
+      mem_pallocation alloc = {
+          .padr       = padr,
+          .header_off = pmm_header_off,
+          .size       = size,
+          .error      = 0,
+      };
+      mem_ppfree(pheader, alloc);
+      return;
+    }
+
+    pmm_header_off += sizeof(mem_pseg_header) + BITMAP_SIZE(h->size);
+  }
+
+  error_inv_state("Freeing physical memory that is not managed");
+}
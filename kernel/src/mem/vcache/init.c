@@ -60,30 +60,31 @@ void vcache_init() {
     }
   }
 
-  // Initialize the PDEs
+  // Initialize the PDEs, one per processor slice
   for (size_t i = 0; i < PDE_COUNT; ++i) {
     mem_pde_ref *pde = i_vcache_pde + i;
     s_alloc_substruct(pde);
-    pde_set_free(pde, 512);
+    pde_set_free(pde, VCACHE_SLICE_LEN);
   }
 
-  // Initiazlixe vcache_pte
-  i_vcache_pte = (mem_pte *)SS_PADR(i_vcache_pde) +
-                 ENTRY_IDX(0, VCACHE_PTR);  // this is probaly +0
-
-  // vcache_pde and vcache_pte are set to their physical addresses
+  // vcache_pde is set to its physical address, and the PTs are reached
+  // through the PDEs physical addresses
   // vcache_map will work until the flat mapping is removed
   // BUT, we can use it to map these pages!
+  // This runs on the BSP, so everything is mapped into the first slice
 
-  // We have PDE_COUNT(4) pages to map for the PTs
+  // We have PDE_COUNT pages to map for the PTs
   // TODO: I hope i can forgive myself for what i am about to do
   // but i know that, in the current state of the machine, vcache_map
   // will return consecutive pages after each call
   // so i will use that knowledge to map the PTs
   // FIXME: please fix asap, this is a sin, and i don't want to die
+  i_vcache_pte = (mem_pte *)SS_PADR(i_vcache_pde) +
+                 ENTRY_IDX(0, VCACHE_PTR);  // this is probaly +0
+
   mem_pte *vpte = 0;
   for (size_t i = 0; i < PDE_COUNT; ++i) {
-    vcache_unit vu = vcache_map(i_vcache_pte + 512 * i);
+    vcache_unit vu = vcache_map(SS_PADR(i_vcache_pde + i));
     if (vu.error) {
       error_general("VCache init", "Could not map vcache PT");
     }
@@ -1,4 +1,5 @@
 #include <attributes.h>
+#include <proc.h>
 #include <stdio.h>
 #include <string.h>
 #include <vcache.h>
@@ -8,72 +9,59 @@
 #include "internal_vcache.h"
 
 // This pointer, after memory initialization, should point
-// to 4 consecutive PDEs that are used for VCache
+// to PDE_COUNT consecutive PDEs that are used for VCache, one per slice
 mem_pde_ref *i_vcache_pde;
 
 // Pointer to the first PTE used by VCache. This PTE should be
-// followed by another 2047 PTE
+// followed by another VCACHE_LEN - 1 PTEs
 mem_pte *i_vcache_pte;
 
+// Returns the index of the slice(PDE) owned by the running processor
+// Before the processor table is built, only the BSP is running, and it
+// always uses the first slice
+static size_t current_slice() {
+  size_t sysid = proc_sysid();
+
+  if (sysid >= VCACHE_SLICE_COUNT) {
+    error_feature("More processors than VCache slices");
+  }
+
+  return sysid;
+}
+
 vcache_unit vcache_map(void *padr) {
   prtrace_begin("vcache_map", "padr=%p", padr);
 
-  // First thing, look if there is a lazy page pointing to this
-  // exact physical address
-  for (size_t pdei = 0; pdei < PDE_COUNT; ++pdei) {
-    mem_pde_ref *pde        = i_vcache_pde + pdei;
-    size_t       lazy_count = pde_lazy_pages(pde);
+  size_t       pde_idx    = current_slice();
+  mem_pde_ref *pde        = i_vcache_pde + pde_idx;
+  mem_pte     *pde_pt     = i_vcache_pte + pde_idx * VCACHE_SLICE_LEN;
+  size_t       lazy_count = pde_lazy_pages(pde);
 
-    if (!lazy_count) {
-      continue;
-    }
-
-    for (size_t ptei = 0; ptei < 512; ++ptei) {
-      mem_pte *pte = i_vcache_pte + pdei * 512 + ptei;
+  // First thing, look if there is a lazy page in our slice pointing to this
+  // exact physical address
+  if (lazy_count) {
+    for (size_t ptei = 0; ptei < VCACHE_SLICE_LEN; ++ptei) {
+      mem_pte *pte = pde_pt + ptei;
       if (pte->present && pte_age(pte) && pte->padr == (uintptr_t)padr >> 12) {
         pte_set_age(pte, 0);
         pde_set_lazy(pde, lazy_count - 1);
 
         vcache_unit u;
         u.error   = 0;
-        u.pde_idx = pdei;
+        u.pde_idx = pde_idx;
         u.pte_idx = ptei;
-        u.ptr     = VCACHE_PTR + MEM_PS * (pdei * 512 + ptei);
+        u.ptr     = VCACHE_PTR + MEM_PS * (pde_idx * VCACHE_SLICE_LEN + ptei);
 
+        prtrace_end("vcache_map", "LAZY_HIT", 0);
         return u;
       }
     }
   }
 
-  // Find a PDE which contains at least 1 free page
+  size_t free_pages_count = pde_free_pages(pde);
 
-  mem_pde_ref *target_pde       = 0;
-  size_t       pde_idx          = 0;
-  size_t       free_pages_count = 0;
-
-  // if 0, then no PDE has any lazy page
-  // if not 0, then it is the number of lazy pages in the first PDE
-  // that has any lazy page
-  size_t lazy_pages_count = 0;
-
-  mem_pte *target_pte = 0;
-  size_t   pte_idx    = 0;
-
-  for (size_t i = 0; i < PDE_COUNT; ++i) {
-    if (!lazy_pages_count) {
-      lazy_pages_count = pde_lazy_pages(i_vcache_pde + i);
-    }
-
-    free_pages_count = pde_free_pages(i_vcache_pde + i);
-    if (free_pages_count) {
-      target_pde = i_vcache_pde + i;
-      pde_idx    = i;
-      break;
-    }
-  }
-
-  if (!target_pde) {
-    if (!lazy_pages_count) {
+  if (!free_pages_count) {
+    if (!lazy_count) {
       // No free pages were found, and no lazy pages could be freed either...
       // Return an error
       vcache_unit err;
@@ -85,70 +73,50 @@ vcache_unit vcache_map(void *padr) {
       prtrace_end("vcache_map", "ERR_VCM_NPG_FOUND", 0);
       return err;
     }
-    // Here, we should free lazy pages, then set target_pde again
-
-    // iterate through all PDEs again, this time looking at their
-    // lazy pages count, not free
-
-    for (size_t i = 0; i < PDE_COUNT; ++i) {
-      if ((free_pages_count = pde_lazy_pages(i_vcache_pde + i))) {
-        size_t lazy_found_count = 0;
-        // Iterate through all PTEs until we found all the lazy pages and
-        // marked them as free
-        target_pde = i_vcache_pde + i;
-        for (size_t j = 0; j < 512; ++i) {
-          // if we already found all the lazy pages, don't bother checking the
-          // other ones, they are all used!
-          if (lazy_found_count >= lazy_pages_count) {
-            break;
-          }
-
-          mem_pte *pte = i_vcache_pte + i * 512;
-          if (mem_vpstruct2_meta(pte)) {  // if it is lazy
-            // also set target_pte to this, so that we don't need to look for it
-            // again after the flush is done
-            target_pte = pte;
-            pte_idx    = j;
-
-            ++lazy_found_count;
-            pte_set_age(pte, 0);
-            pte->present = 0;
-
-            // Don't even bother invalidating the page, it will be invalidated
-            // when mapped again
-          }
-        }
-        // Mark all the previously lazy pages as free now
-        pde_set_free(target_pde, lazy_pages_count);
-        pde_set_lazy(target_pde, 0);
-
-        // We only flush one PDE, do not bother with the other ones as that is
-        // not needed now, and with chance, maybe they contain pages that
-        // will soon be mapped again, so it's better they stay
+
+    // Mark all the lazy pages of the slice as free
+    size_t lazy_found_count = 0;
+    for (size_t i = 0; i < VCACHE_SLICE_LEN; ++i) {
+      // if we already found all the lazy pages, don't bother checking the
+      // other ones, they are all used!
+      if (lazy_found_count >= lazy_count) {
         break;
       }
+
+      mem_pte *pte = pde_pt + i;
+      if (pte_age(pte)) {  // if it is lazy
+        ++lazy_found_count;
+        pte_set_age(pte, 0);
+        pte->present = 0;
+
+        // Don't even bother invalidating the page, it will be invalidated
+        // when mapped again, and no other processor ever touches it
+      }
     }
+    free_pages_count = lazy_count;
+    pde_set_lazy(pde, 0);
   }
 
-  // Here we have a pde, we will decrement its `free` attribute
-  pde_set_free(target_pde, free_pages_count - 1);
+  // Here we have free pages, we will decrement the `free` attribute
+  pde_set_free(pde, free_pages_count - 1);
 
-  // If we went through a flush, then target_pte is already set
-  if (!target_pte) {
-    target_pte = i_vcache_pte + pde_idx * 512;
-    // Now we iterate through all PTEs in this PDE and find one that is
-    // not present
-    for (size_t i = 0; i < 512; ++i) {
-      if (!target_pte[i].present) {
-        target_pte = target_pte + i;
-        pte_idx    = i;
-        break;
-      }
+  // Now we iterate through all PTEs in the slice and find one that is
+  // not present
+  mem_pte *target_pte = 0;
+  size_t   pte_idx    = 0;
+  for (size_t i = 0; i < VCACHE_SLICE_LEN; ++i) {
+    if (!pde_pt[i].present) {
+      target_pte = pde_pt + i;
+      pte_idx    = i;
+      break;
     }
-    // Mark the page as NOT lazy
-    pte_set_age(target_pte, 0);
   }
-  // Now that we have a PTE, we set it up
+
+  if (!target_pte) {
+    error_inv_state("VCache slice free count out of sync with its PTEs");
+  }
+
+  // Now that we have a PTE, we set it up, which also marks it as NOT lazy
   memset(target_pte, 0, sizeof(*target_pte));
 
   target_pte->write   = 1;
@@ -156,8 +124,9 @@ vcache_unit vcache_map(void *padr) {
   target_pte->padr    = (uintptr_t)padr >> 12;
   target_pte->present = 1;
 
-  void *ptr = VCACHE_PTR + MEM_PS * (pde_idx * 512 + pte_idx);
+  void *ptr = VCACHE_PTR + MEM_PS * (pde_idx * VCACHE_SLICE_LEN + pte_idx);
 
+  // The slice is private, a local invalidation is all that is needed
   as_invlpg((uint64_t)ptr);
 
   vcache_unit unit;
@@ -181,7 +150,8 @@ void vcache_remap(vcache_unit unit, void *padr) {
   //   unit.ptr, unit.pde_idx, unit.pte_idx, padr
   // );
 
-  mem_pte *pte = i_vcache_pte + unit.pde_idx * 512 + unit.pte_idx;
+  mem_pte *pte =
+      i_vcache_pte + unit.pde_idx * VCACHE_SLICE_LEN + unit.pte_idx;
 
   // If this PTE already points to padr, skip the function
   if (pte->present && pte->padr == (uintptr_t)padr >> 12) {
@@ -197,7 +167,8 @@ void vcache_remap(vcache_unit unit, void *padr) {
   pte->padr    = (uintptr_t)padr >> 12;
   pte->present = 1;
 
-  void *ptr = VCACHE_PTR + MEM_PS * (unit.pde_idx * 512 + unit.pte_idx);
+  void *ptr =
+      VCACHE_PTR + MEM_PS * (unit.pde_idx * VCACHE_SLICE_LEN + unit.pte_idx);
 
   as_invlpg((uint64_t)ptr);
 
@@ -217,22 +188,20 @@ void vcache_umap(vcache_unit unit, void *id) {
   // First, check how many lazy pages the PDE has
   // If it is less than 127(the maximum), then the process is
   // straighforward. Mark this page as lazy with age 1, then return
-  mem_pde_ref *pde = i_vcache_pde + unit.pde_idx;
-  mem_pte     *pte = i_vcache_pte + unit.pde_idx * 512 + unit.pte_idx;
-
-  // Pointer to the 512 PTEs pointed to by the PDE
-  mem_pte *pde_pt = i_vcache_pte + 512 * unit.pde_idx;
+  mem_pde_ref *pde    = i_vcache_pde + unit.pde_idx;
+  mem_pte     *pde_pt = i_vcache_pte + VCACHE_SLICE_LEN * unit.pde_idx;
+  mem_pte     *pte    = pde_pt + unit.pte_idx;
 
   size_t lazy_count = pde_lazy_pages(pde);
 
   // This should be the majority of the first cases
   if (lazy_count < 63) {
     // Increment the age of the other lazy pages
-    for (size_t i = 0; i < 512; ++i) {
+    for (size_t i = 0; i < VCACHE_SLICE_LEN; ++i) {
       mem_pte *current_pte = pde_pt + i;
       size_t   age         = pte_age(current_pte);
       if (age && age < 1023) {
-        pte_set_age(current_pte, age + i);
+        pte_set_age(current_pte, age + 1);
       }
     }
     if (id == VCACHE_AUTO_ID) {
@@ -253,7 +222,7 @@ void vcache_umap(vcache_unit unit, void *id) {
   mem_pte *oldest_pte = 0;
 
   // We do a first run removing the oldest lazy PTE
-  for (size_t i = 0; i < 512; ++i) {
+  for (size_t i = 0; i < VCACHE_SLICE_LEN; ++i) {
     size_t age = pte_age(pde_pt + i);
     if (age > oldest_age) {
       oldest_pte = pde_pt + i;
@@ -277,7 +246,7 @@ void vcache_umap(vcache_unit unit, void *id) {
 
   // Now iterate again, freeing all lazy pages who are older than the average
   // and incrementing the ages of the ones that will stay
-  for (size_t i = 0; i < 512; ++i) {
+  for (size_t i = 0; i < VCACHE_SLICE_LEN; ++i) {
     mem_pte *current_pte = pde_pt + i;
     size_t   age         = pte_age(current_pte);
 
@@ -1,4 +1,6 @@
+#include <lock.h>
 #include <mem.h>
+#include <smp.h>
 #include <stdio.h>
 #include <string.h>
 #include <utils.h>
@@ -9,7 +11,11 @@
 
 #include "internal_mem.h"
 
-errno_t mem_vmap(void *vadr, void *padr, size_t size, int flags) {
+// Serializes mappings, two processors mapping under the same missing
+// structure would both create it, and the structure counts are not atomic
+static spinlock vmap_lock = {0};
+
+static errno_t vmap(void *vadr, void *padr, size_t size, int flags) {
   prtrace_begin(
       "mem_vmap",
       "vadr=%p,padr=%p,size=%lu,flags=%032b",
@@ -101,6 +107,8 @@ errno_t mem_vmap(void *vadr, void *padr, size_t size, int flags) {
         );
 
         if (alloc.error) {
+          vcache_umap(vmap_unit[0], 0);
+          vcache_umap(vmap_unit[1], 0);
           prtrace_end("mem_vmap", "ERR_MEM_NO_PHY_SPACE", 0);
           return ERR_MEM_NO_PHY_SPACE;
         }
@@ -213,19 +221,206 @@ errno_t mem_vmap(void *vadr, void *padr, size_t size, int flags) {
   return 0;
 }
 
-errno_t mem_vumap(void *vadr, size_t size) {
-  // Trashy temporary implementation, that only marks the page as not
-  // present This trashy temporary implementation does not bother freeing
-  // the physical space used by virtual memory structures when it's
-  // currently unneeded Me lazy rn, I just want it to work
-  // FIXME: Hey, when you're not lazy anymore, properly implement this!!!
+errno_t mem_vmap(void *vadr, void *padr, size_t size, int flags) {
+  uint64_t rflags = spin_lock_irqsave(&vmap_lock);
+  errno_t  err    = vmap(vadr, padr, size, flags);
+  spin_unlock_irqrestore(&vmap_lock, rflags);
+  return err;
+}
+
+// What unmap_range does with the physical pages it unmapped
+#define UNMAP_KEEP (0)  // Nothing, the caller owns them
+#define UNMAP_FREE (1)  // Give them back to the PMM
+#define UNMAP_MOVE (2)  // Map them again, at the same offset from move_to
+
+// Value of the ignored bits of the entries unmap_range took out, they keep
+// their address until the other processors flushed them
+#define ENTRY_TAKEN (1)
+
+// Walks the paging structures down to the entry that maps vadr, mapping the
+// structures in the two units of cache as it goes
+// Returns the entry, or 0 if vadr is not mapped, in both cases order is set
+// to the order of the last entry looked at. With taken set, the entry is
+// only returned if unmap_range took it out
+static void *find_page_entry(
+    void *vadr, vcache_unit *cache, int *order, bool taken
+) {
+  mem_vpstruct_ptr *entry = i_pmlmax + ENTRY_IDX(MAX_ORDER, vadr);
+
+  // Structures are never taken out, only the entries that map pages
+  for (*order = MAX_ORDER; *order && entry->present && !entry->ps; --*order) {
+    vcache_remap(cache[*order % 2], SS_PADR(entry));
+    entry = (mem_vpstruct_ptr *)cache[*order % 2].ptr +
+            ENTRY_IDX(*order - 1, vadr);
+  }
 
-  // Actually, why even bother marking the page as unpresent at this point
-  // Just return 0 who cares rn, i wanna work on malloc now
+  mem_pte *last = (mem_pte *)entry;
+  if (taken) {
+    return !last->present && last->free0 == ENTRY_TAKEN ? entry : 0;
+  }
+  return last->present ? entry : 0;
+}
 
+// Hands a run of unmapped pages on, once no processor can use it anymore
+static errno_t release_run(
+    int mode, void *run_padr, size_t run_size, void *dst, int flags
+) {
+  if (mode == UNMAP_FREE) {
+    mem_ppfree_padr(PALLOC_STD_HEADER, run_padr, run_size);
+  } else if (mode == UNMAP_MOVE) {
+    return mem_vmap(dst, run_padr, run_size, flags);
+  }
   return 0;
 }
 
+// Unmaps every page in [vadr, vadr+size), pages that are not mapped are
+// skipped, what happens to the physical pages is decided by mode. When
+// moving, the page at vadr+x is mapped again at move_to+x using flags
+static errno_t unmap_range(
+    void *vadr, size_t size, int mode, void *move_to, int flags
+) {
+  if (!size) {
+    return ERR_MEM_NULL_SIZE;
+  }
+
+  if ((uintptr_t)vadr % MEM_PS || (uintptr_t)move_to % MEM_PS) {
+    return ERR_MEM_ALN;
+  }
+
+  if (VCACHE_PTR <= vadr && vadr < (VCACHE_PTR + VCACHE_SIZE)) {
+    return ERR_MEM_MANAGED;
+  }
+
+  vcache_unit cache[2] = {vcache_map(0), vcache_map(0)};
+  if (cache[0].error || cache[1].error) {
+    for (size_t i = 0; i < 2; ++i) {
+      if (!cache[i].error) {
+        vcache_umap(cache[i], 0);
+      }
+    }
+    return ERR_MEM_NO_VC_SPACE;
+  }
+
+  errno_t err   = 0;
+  bool    taken = false;
+  void   *start = vadr;
+  void   *end   = vadr + ALIGN_UP(size, MEM_PS);
+
+  // The entries are taken out first, the other processors may still use
+  // them until the one shootdown for the whole range
+  while (vadr < end) {
+    int   order;
+    void *entry = find_page_entry(vadr, cache, &order, false);
+    void *next  = (void *)ALIGN_DN((uintptr_t)vadr, ORDER_PS(order)) +
+                 ORDER_PS(order);
+
+    if (entry) {
+      // Large pages can only be unmapped whole
+      if (order && ((uintptr_t)vadr % ORDER_PS(order) || end < next)) {
+        err = ERR_MEM_ALN;
+        end = vadr;
+        break;
+      }
+
+      mem_pte *pte = entry;
+      pte->present = 0;
+      pte->free0   = ENTRY_TAKEN;
+      as_invlpg((uint64_t)vadr);
+      taken = true;
+    }
+
+    // The end of the address space
+    if (next < vadr) {
+      break;
+    }
+    vadr = next;
+  }
+
+  if (!taken) {
+    vcache_umap(cache[0], 0);
+    vcache_umap(cache[1], 0);
+    return err;
+  }
+  smp_tlb_shootdown(start, end - start);
+
+  // Pages that are consecutive, both physically and virtually, are handed
+  // on as one run, given back to the PMM or mapped again all at once
+  void  *run_vadr = 0;
+  void  *run_padr = 0;
+  size_t run_size = 0;
+
+  for (vadr = start; vadr < end;) {
+    int   order;
+    void *entry = find_page_entry(vadr, cache, &order, true);
+    void *next  = (void *)ALIGN_DN((uintptr_t)vadr, ORDER_PS(order)) +
+                 ORDER_PS(order);
+
+    if (entry) {
+      void *padr;
+      if (order) {
+        padr = (void *)((uintptr_t)((mem_vpstruct *)entry)->padr << 13);
+      } else {
+        padr = (void *)((uintptr_t)((mem_pte *)entry)->padr << 12);
+      }
+      memset(entry, 0, sizeof(mem_pte));
+
+      // Pages kept by the caller only need to be virtually consecutive
+      bool split = run_vadr + run_size != vadr ||
+                   (mode != UNMAP_KEEP && run_padr + run_size != padr);
+      if (run_size && split) {
+        void   *dst     = move_to + (run_vadr - start);
+        errno_t run_err = release_run(mode, run_padr, run_size, dst, flags);
+        err             = err ? err : run_err;
+        run_size        = 0;
+      }
+      if (!run_size) {
+        run_vadr = vadr;
+        run_padr = padr;
+      }
+      run_size += ORDER_PS(order);
+    }
+
+    if (next < vadr) {
+      break;
+    }
+    vadr = next;
+  }
+
+  if (run_size) {
+    void   *dst     = move_to + (run_vadr - start);
+    errno_t run_err = release_run(mode, run_padr, run_size, dst, flags);
+    err             = err ? err : run_err;
+  }
+
+  vcache_umap(cache[0], 0);
+  vcache_umap(cache[1], 0);
+
+  return err;
+}
+
+errno_t mem_vumap(void *vadr, size_t size) {
+  // Only the mappings are removed, paging structures that become empty are
+  // kept, they are likely to be needed again and their reference counts are
+  // not precise enough to know when they really are empty
+  prtrace_begin("mem_vumap", "vadr=%p,size=%lu", vadr, size);
+
+  errno_t err = unmap_range(vadr, size, UNMAP_KEEP, 0, 0);
+
+  prtrace_end("mem_vumap", err ? "ERROR" : "SUCCESS", "err=%d", err);
+  return err;
+}
+
+errno_t mem_vmove(void *dst, void *src, size_t size, int flags) {
+  // The physical pages stay where they are, only the page entries change,
+  // so moving is proportional to the number of pages, not of bytes
+  prtrace_begin("mem_vmove", "dst=%p,src=%p,size=%lu", dst, src, size);
+
+  errno_t err = unmap_range(src, size, UNMAP_MOVE, dst, flags);
+
+  prtrace_end("mem_vmove", err ? "ERROR" : "SUCCESS", "err=%d", err);
+  return err;
+}
+
 static void recursive_find_vseg(
     size_t            req,
     vcache_unit      *cache,
@@ -359,22 +554,41 @@ mem_vseg mem_alloc_vblock(
     return seg;
   }
 
-  mem_alloc_into(seg.ptr, size, flags);
+  if (!mem_alloc_into(seg.ptr, size, flags)) {
+    return (mem_vseg){0, 0, MEM_VSEG_ERROR_NMEM};
+  }
   return seg;
 }
 
+void mem_free_vblock(void *vptr, size_t size) {
+  prtrace_begin("mem_free_vblock", "vptr=%p,size=%lu", vptr, size);
+
+  errno_t err = unmap_range(vptr, size, UNMAP_FREE, 0, 0);
+  if (err) {
+    error_inv_state("Could not free virtual block");
+  }
+
+  prtrace_end("mem_free_vblock", "SUCCESS", 0);
+}
+
 void *mem_alloc_into(void *vptr, size_t size, int flags) {
   size_t allocated = 0;
   while (allocated < size) {
     mem_pallocation alloc =
         mem_ppalloc(PALLOC_STD_HEADER, size - allocated, 0, false, 0);
-    if (alloc.error) {
-      // TODO: Instead of error, we need to find a way to deallocate
-      // all the allocated phyical pages and return 0
-      error_out_of_memory("Could not allocate physical memory");
+    if (!alloc.error &&
+        mem_vmap(vptr + allocated, alloc.padr, alloc.size, flags)) {
+      mem_ppfree_padr(PALLOC_STD_HEADER, alloc.padr, alloc.size);
+      alloc.error = ERR_MEM_NO_PHY_SPACE;
     }
 
-    mem_vmap(vptr + allocated, alloc.padr, alloc.size, flags);
+    // Out of memory, what was mapped so far is given back
+    if (alloc.error) {
+      if (allocated) {
+        unmap_range(vptr, allocated, UNMAP_FREE, 0, 0);
+      }
+      return 0;
+    }
     allocated += alloc.size;
   }
   return vptr;
@@ -1,12 +1,44 @@
+#include <lock.h>
 #include <mutex.h>
 #include <sys.h>
 
+bool mutex_trylock(mutex *mutex) {
+  return !__atomic_load_n(&mutex->locked, __ATOMIC_RELAXED) &&
+         !__atomic_exchange_n(&mutex->locked, 1, __ATOMIC_ACQUIRE);
+}
+
 void mutex_lock(mutex *mutex) {
-  while (!__sync_bool_compare_and_swap(mutex, 0, 1)) {
+  if (mutex_trylock(mutex)) {
+    lock_stat_acquired(mutex, 0, __builtin_return_address(0));
+    return;
+  }
+
+  uint64_t start = lock_stat_clock();
+  for (size_t i = 0; i < MUTEX_SPIN; ++i) {
     pause();
+    if (mutex_trylock(mutex)) {
+      goto acquired;
+    }
   }
+
+  while (true) {
+    wait_event(&mutex->waiters, !mutex->locked);
+    if (mutex_trylock(mutex)) {
+      break;
+    }
+  }
+
+acquired:
+  lock_stat_acquired(
+      mutex, lock_stat_clock() - start, __builtin_return_address(0)
+  );
 }
 
-void mutex_ulock(mutex *mutex) {
-  *mutex = 0;
+void mutex_unlock(mutex *mutex) {
+  // The exchange orders the release before the look at the queue, a waiter
+  // queues itself before looking at the mutex
+  __atomic_exchange_n(&mutex->locked, 0, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&mutex->waiters.head, __ATOMIC_RELAXED)) {
+    wake_up(&mutex->waiters);
+  }
 }
@@ -1,63 +1,126 @@
 #include <apic.h>
 #include <boot_info.h>
+#include <clock.h>
 #include <cpuid.h>
 #include <env.h>
 #include <interrupts.h>
+#include <kmem.h>
 #include <kshell.h>
-#include <mutex.h>
+#include <lock.h>
 #include <proc.h>
+#include <rcu.h>
+#include <sched.h>
+#include <smp.h>
 #include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys.h>
+#include <timer.h>
+#include <topology.h>
 #include <userspace.h>
 #include <utils.h>
+#include <wait.h>
 
+#include <asm/msr.h>
 #include <asm/sys.h>
 #include <asm/userspace.h>
-#include <dts/hashtable.h>
 
 // Set to 1 by BSP to tell other processors they can go to their event loop
-static atomic_bool ignition  = 0;
-static mutex       init_lock = 0;
+static atomic_bool ignition      = 0;
+static wait_queue  ignition_wait = {0};
+static spinlock    init_lock     = {0};
+
+static spinlock    proc_register_lock = {0};
+static kmem_cache *proc_info_cache    = 0;
+static size_t      numcores           = 0;
+
+// Sysids by APIC ID, filled while parsing the ACPI tables, before the other
+// processors are started, they find their proc_cpu with it
+static uint8_t sysids[PROC_MAX_APICID];
+
+_Static_assert(
+    offsetof(proc_cpu, kstack_top) == PROC_CPU_KSTACK_TOP, "See sys.asm"
+);
+_Static_assert(offsetof(proc_cpu, user_sp) == PROC_CPU_USER_SP, "See sys.asm");
+
+static proc_cpu proc_cpus[PROC_MAX_COUNT];
+// Used by the other processors until ignition, they do not know their sysid
+// before the ACPI tables are parsed, it looks like sysid 0 with no task
+static proc_cpu proc_boot_cpu = {.self = &proc_boot_cpu};
+
+static void proc_cpu_load(proc_cpu *cpu) {
+  cpu->self = cpu;
+  as_lmsr(MSR_IA32_GS_BASE, (uintptr_t)cpu);
+  // The GS base of user mode
+  as_lmsr(MSR_IA32_KERNEL_GS_BASE, 0);
+}
+
+// The first user program runs as a task like any other
+static void init_entry(void *arg) {
+  exec();
+}
+
+void proc_early_init() {
+  // The only cpuid left, the BSP is always sysid 0
+  uint32_t apicid = apic_getid();
+  if (apicid != bootboot.bspid) {
+    proc_cpu_load(&proc_boot_cpu);
+    return;
+  }
 
-// Hashtable indexable by APIC ID, there exist as many entries as CPUs in the
-// system
-static dts_hashtable *proc_table = 0;
-static size_t         numcores   = 0;
+  proc_cpu *cpu = proc_cpus;
+  cpu->apicid   = apicid;
+  cpu->primary  = true;
+  proc_cpu_load(cpu);
+}
 
 uint32_t proc_getid() {
-  return apic_getid();
+  return this_cpu_read(apicid);
+}
+
+size_t proc_sysid() {
+  return this_cpu_read(sysid);
 }
 
 int proc_isprimary() {
-  return apic_getid() == bootboot.bspid;
+  return this_cpu_read(primary);
 }
 
 void proc_ignition_wait() {
-  while (!ignition) {
-    pause();
+  // Interrupts are still disabled, processors with mwait sleep until the
+  // flag is set, others spin
+  wait_event(&ignition_wait, ignition);
+
+  // Processors past PROC_MAX_COUNT or PROC_MAX_APICID are not registered,
+  // they keep the placeholder and are parked by proc_init
+  uint32_t apicid = apic_getid();
+  if (apicid < PROC_MAX_APICID) {
+    proc_cpu *cpu = proc_cpus + sysids[apicid];
+    if (cpu->info && cpu->apicid == apicid) {
+      proc_cpu_load(cpu);
+    }
+  } else {
+    printd("Not starting processor(apicid=%u), ID too large\n", apicid);
+  }
+
+  // Processors that are not registered never read the clock
+  if (proc_getinfo()) {
+    clock_sync();
   }
   proc_init();
 }
 
 void proc_ignite() {
-  // A few things to do before waking up the other cores
-  // Like allocating space for the stack table
-  mem_vseg stacktableseg =
-      mem_alloc_vblock(0x1000, MAPF_W | MAPF_R, STACK_TABLE_VPTR, 0x1000);
-
-  if (stacktableseg.error) {
-    error_out_of_memory("Could not allocate spa efor stack table");
-  }
-  // That's it for now
-
   ignition = true;
+  wake_up_all(&ignition_wait);
+
+  clock_sync_serve(proc_numcores() - 1);
   proc_init();
 }
 
 void proc_init() {
-  mutex_lock(&init_lock);
+  spin_lock(&init_lock);
 
   // We need to figure out what is our stack
   int   x;
@@ -66,8 +129,14 @@ void proc_init() {
 
   proc_info *pinfo = proc_getinfo();
 
-  // Stack base should be written in the stack table as well.
-  STACK_TABLE_VPTR[pinfo->apicid] = stack_base;
+  // Processors past PROC_MAX_COUNT are not registered, park them
+  if (!pinfo) {
+    spin_unlock(&init_lock);
+    stop();
+  }
+
+  // System calls land there until the scheduler runs a task
+  this_cpu_write(kstack_top, stack_base);
 
   // Continue filling up proc_info of current processor
   pinfo->ksatck = stack_base;
@@ -81,19 +150,30 @@ void proc_init() {
 
   int_load();
   apic_init();
+  timer_init();
+  smp_online();
+  topo_init();
   as_enable_syscall(as_syscall_handle);
 
-  mutex_ulock(&init_lock);
+  spin_unlock(&init_lock);
 
   if (proc_isprimary()) {
     printd("Total number of cores: %lu\n", proc_numcores());
   }
 
-  // Next, we go on a loop that simply halts repeatedly
-  // I am doing it in assembly instead of C so that I can be 100% sure no
-  // stack is being manipulated
-  // This also enables interrupts
-  as_event_loop();
+  // This processor takes part in RCU grace periods from now on
+  rcu_online();
+
+  if (proc_isprimary()) {
+    task *init = task_create(init_entry, 0);
+    if (!init) {
+      error_out_of_memory("Could not allocate init task");
+    }
+    sched_add(init);
+  }
+
+  // The boot stack becomes the idle task, this also enables interrupts
+  sched_start();
 }
 
 uint32_t proc_bus_freq() {
@@ -104,23 +184,53 @@ uint32_t proc_bus_freq() {
   return bus_freq;
 }
 
+proc_info *proc_create_info() {
+  if (!proc_info_cache) {
+    spin_lock(&proc_register_lock);
+    if (!proc_info_cache) {
+      proc_info_cache =
+          kmem_cache_create("proc_info", sizeof(proc_info), 0, 0);
+    }
+    spin_unlock(&proc_register_lock);
+  }
+
+  proc_info *info = kmem_cache_alloc(proc_info_cache);
+  if (!info) {
+    error_out_of_memory("Could not allocate processor info");
+  }
+  memset(info, 0, sizeof(*info));
+  return info;
+}
+
 void proc_register(uint32_t apic_id, proc_info *info) {
-  if (!proc_table) {
-    proc_table = dts_hashtable_create_uptrkey(0);
-    // Error handling my ass
+  if (apic_id >= PROC_MAX_APICID) {
+    printd("Not registering processor(apicid=%u), ID too large\n", apic_id);
+    return;
   }
 
-  void *apic_id_key = (void *)(uintptr_t)apic_id;
+  // Serializes the look for a conflicting ID with the insertion
+  spin_lock(&proc_register_lock);
+
+  proc_cpu *prev  = proc_cpus + sysids[apic_id];
+  bool      found = prev->info && prev->apicid == apic_id;
 
-  bool found = false;
-  dts_hashtable_search(proc_table, apic_id_key, &found);
+  if (!found) {
+    ++numcores;
+    sysids[apic_id] = info->sysid;
+
+    // The BSP's is already in use, the others are loaded at ignition
+    proc_cpu *cpu = proc_cpus + info->sysid;
+    cpu->sysid    = info->sysid;
+    cpu->apicid   = apic_id;
+    cpu->primary  = apic_id == bootboot.bspid;
+    cpu->info     = info;
+  }
+
+  spin_unlock(&proc_register_lock);
 
   if (found) {  // should not happen
     printd("Found conflicting APIC IDs: %u\n", apic_id);
-    return;
   }
-  ++numcores;
-  dts_hashtable_insert(proc_table, apic_id_key, info);
 }
 
 size_t proc_numcores() {
@@ -128,5 +238,7 @@ size_t proc_numcores() {
 }
 
 proc_info *proc_getinfo() {
-  return dts_hashtable_search(proc_table, (void *)(uintptr_t)proc_getid(), 0);
+  // Processors are registered while parsing the ACPI tables, anything
+  // running before that runs on the BSP and has no proc_info yet
+  return this_cpu_read(info);
 }
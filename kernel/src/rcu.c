@@ -0,0 +1,128 @@
+#include <interrupts.h>
+#include <proc.h>
+#include <rcu.h>
+#include <sys.h>
+
+// Last grace period started, grace periods are numbered from 1
+static volatile uint64_t rcu_gp = 0;
+
+static rcu_cpu rcu_cpus[PROC_MAX_COUNT];
+
+// Checks if every online processor went through a quiescent state since gp
+// started
+static bool gp_done(uint64_t gp) {
+  for (size_t i = 0; i < PROC_MAX_COUNT; ++i) {
+    rcu_cpu *cpu = rcu_cpus + i;
+    if (cpu->online && __atomic_load_n(&cpu->seen, __ATOMIC_ACQUIRE) < gp) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void run_callbacks(rcu_head *head) {
+  while (head) {
+    rcu_head *next = head->next;
+    head->func(head);
+    head = next;
+  }
+}
+
+void rcu_online() {
+  uint64_t rflags = int_save();
+  rcu_cpu *cpu    = rcu_cpus + proc_sysid();
+
+  cpu->seen = rcu_gp;
+  // Callbacks may have been queued at boot already
+  if (!cpu->next_tail) {
+    cpu->next_tail = &cpu->next;
+  }
+  // A grace period that does not see us online started before we could
+  // read anything it protects
+  __sync_synchronize();
+  cpu->online = true;
+  // Nothing is read until grace periods can see us, the store must not
+  // pass the loads that follow
+  __sync_synchronize();
+
+  int_restore(rflags);
+}
+
+void rcu_quiescent() {
+  uint64_t rflags = int_save();
+  rcu_cpu *cpu    = rcu_cpus + proc_sysid();
+
+  // Everything read before is done with
+  __atomic_store_n(&cpu->seen, rcu_gp, __ATOMIC_RELEASE);
+
+  rcu_head *done = 0;
+  if (cpu->wait && gp_done(cpu->wait_gp)) {
+    done      = cpu->wait;
+    cpu->wait = 0;
+  }
+
+  // Callbacks queued since the last batch start a grace period of their own,
+  // we are quiescent already, so we do not hold it back
+  if (!cpu->wait && cpu->next) {
+    cpu->wait      = cpu->next;
+    cpu->next      = 0;
+    cpu->next_tail = &cpu->next;
+    cpu->wait_gp   = __sync_add_and_fetch(&rcu_gp, 1);
+    __atomic_store_n(&cpu->seen, cpu->wait_gp, __ATOMIC_RELEASE);
+  }
+
+  int_restore(rflags);
+
+  // Callbacks run with interrupts as they were, they usually free memory
+  run_callbacks(done);
+}
+
+bool rcu_needs_cpu() {
+  rcu_cpu *cpu = rcu_cpus + proc_sysid();
+  return cpu->next || cpu->wait;
+}
+
+void rcu_idle_enter() {
+  rcu_cpu *cpu = rcu_cpus + proc_sysid();
+
+  // Grace periods stop waiting for us, everything read is done with
+  cpu->idle = true;
+  __atomic_store_n(&cpu->online, false, __ATOMIC_RELEASE);
+}
+
+void rcu_idle_exit() {
+  rcu_cpu *cpu = rcu_cpus + proc_sysid();
+  if (cpu->idle) {
+    cpu->idle = false;
+    rcu_online();
+  }
+}
+
+void synchronize_rcu() {
+  uint64_t gp = __sync_add_and_fetch(&rcu_gp, 1);
+
+  // The caller is not in a read side section
+  rcu_quiescent();
+
+  while (!gp_done(gp)) {
+    pause();
+  }
+}
+
+void call_rcu(rcu_head *head, rcu_callback_f func) {
+  head->next = 0;
+  head->func = func;
+
+  uint64_t rflags = int_save();
+  rcu_cpu *cpu    = rcu_cpus + proc_sysid();
+
+  // Before the processor is online nobody can be reading, but the tail is
+  // not set up yet either, the callback waits for the first quiescent state
+  if (!cpu->next_tail) {
+    cpu->next_tail = &cpu->next;
+  }
+  *cpu->next_tail = head;
+  cpu->next_tail  = &head->next;
+
+  int_restore(rflags);
+}
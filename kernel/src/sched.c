@@ -0,0 +1,448 @@
+#include <apic.h>
+#include <interrupts.h>
+#include <mem.h>
+#include <proc.h>
+#include <rcu.h>
+#include <sched.h>
+#include <stdint.h>
+#include <sys.h>
+#include <timer.h>
+#include <topology.h>
+
+#include <asm/task.h>
+
+static sched_rq rqs[PROC_MAX_COUNT];
+
+static sched_rq *this_rq() {
+  return rqs + proc_sysid();
+}
+
+// Both with the queue locked
+static void rq_push(sched_rq *rq, task *t) {
+  t->next = 0;
+  t->cpu  = rq - rqs;
+
+  if (rq->tail) {
+    rq->tail->next = t;
+  } else {
+    rq->head = t;
+  }
+  rq->tail = t;
+  ++rq->len;
+  rq->pinned += t->pinned;
+}
+
+static task *rq_pop(sched_rq *rq) {
+  task *t = rq->head;
+  if (t) {
+    rq->head = t->next;
+    if (!rq->head) {
+      rq->tail = 0;
+    }
+    --rq->len;
+    rq->pinned -= t->pinned;
+  }
+  return t;
+}
+
+static size_t rq_load(sched_rq *rq) {
+  return rq->len + (rq->cur != rq->idle);
+}
+
+static bool rq_isidle(sched_rq *rq) {
+  return rq->online && rq->cur == rq->idle && !rq->len;
+}
+
+// Sum of the loads of a domain of the processor with the given sysid
+static size_t domain_load(size_t sysid, topo_level level) {
+  size_t load = 0;
+  for (cpu_mask left = topo_domain(sysid, level); left; left &= left - 1) {
+    sched_rq *rq = rqs + __builtin_ctzll(left);
+    if (rq->online) {
+      load += rq_load(rq);
+    }
+  }
+  return load;
+}
+
+// The idle processor closest to the one with the given sysid, up to the
+// given domain, other than skip, or 0
+static sched_rq *rq_find_idle(size_t sysid, topo_level max, sched_rq *skip) {
+  cpu_mask looked = 0;
+  for (topo_level level = TOPO_SMT; level <= max; ++level) {
+    cpu_mask domain = topo_domain(sysid, level) & ~looked;
+    looked         |= domain;
+
+    for (cpu_mask left = domain; left; left &= left - 1) {
+      sched_rq *rq = rqs + __builtin_ctzll(left);
+      if (rq != skip && rq_isidle(rq)) {
+        return rq;
+      }
+    }
+  }
+  return 0;
+}
+
+// The other queue with the most tasks that can be stolen, or 0 if there
+// are none, looked at without locking. Closer domains are looked at first,
+// the task may find some of its data in a shared cache
+static sched_rq *rq_busiest(sched_rq *self) {
+  size_t   sysid  = self - rqs;
+  cpu_mask looked = CPU_MASK_OF(sysid);
+
+  for (topo_level level = TOPO_SMT; level < TOPO_LEVELS; ++level) {
+    cpu_mask domain = topo_domain(sysid, level) & ~looked;
+    looked         |= domain;
+
+    sched_rq *busiest = 0;
+    size_t    max     = 0;
+    for (cpu_mask left = domain; left; left &= left - 1) {
+      sched_rq *rq = rqs + __builtin_ctzll(left);
+      if (!rq->online) {
+        continue;
+      }
+
+      size_t stealable = rq->len - rq->pinned;
+      if (stealable > max) {
+        busiest = rq;
+        max     = stealable;
+      }
+    }
+    if (busiest) {
+      return busiest;
+    }
+  }
+  return 0;
+}
+
+// Takes the first task that is not pinned off the queue, if there is one,
+// with the queue locked
+static task *rq_pop_unpinned(sched_rq *rq) {
+  task *prev = 0;
+  task *t    = rq->head;
+  while (t && t->pinned) {
+    prev = t;
+    t    = t->next;
+  }
+  if (!t) {
+    return 0;
+  }
+
+  if (prev) {
+    prev->next = t->next;
+  } else {
+    rq->head = t->next;
+  }
+  if (rq->tail == t) {
+    rq->tail = prev;
+  }
+  --rq->len;
+  return t;
+}
+
+static task *rq_steal(sched_rq *self) {
+  sched_rq *busiest = rq_busiest(self);
+
+  // Never wait on another processor's queue, a busy one is tried again on
+  // the next pass of the idle loop
+  if (!busiest || !spin_trylock(&busiest->lock)) {
+    return 0;
+  }
+  task *t = rq_pop_unpinned(busiest);
+  spin_unlock(&busiest->lock);
+  return t;
+}
+
+// Wakes the processor of rq up if a task was queued on it while it sleeps,
+// or another one to steal the task if it is busy. The task itself may be
+// running already, and gone
+static void rq_kick(sched_rq *rq, bool pinned) {
+  sched_rq *self = this_rq();
+
+  // Orders the queueing before the look at the flags, the idle loop sets
+  // its flag before looking at the queues
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (rq->sleeping || rq->cur == rq->idle) {
+    if (rq->sleeping && rq != self) {
+      apic_send_ipi(rq->pinfo->apicid, APIC_KICK_VECTOR);
+    }
+    return;
+  }
+  if (pinned) {
+    return;
+  }
+
+  // The closest idle processor steals it first, one that is not sleeping
+  // finds it on its own
+  sched_rq *idle = rq_find_idle(rq - rqs, TOPO_ALL, self);
+  if (idle && idle->sleeping) {
+    apic_send_ipi(idle->pinfo->apicid, APIC_KICK_VECTOR);
+  }
+}
+
+static void switch_finish(task *last) {
+  // Exited tasks are freed once nothing runs on their stack
+  if (last->state == TASK_ZOMBIE) {
+    task_destroy(last);
+    return;
+  }
+  __atomic_store_n(&last->on_cpu, false, __ATOMIC_RELEASE);
+}
+
+static void switch_to(sched_rq *rq, task *prev, task *next) {
+  // A task woken or stolen right as it was being switched out waits for its
+  // previous processor to leave its stack
+  while (__atomic_load_n(&next->on_cpu, __ATOMIC_ACQUIRE)) {
+    pause();
+  }
+  next->on_cpu = true;
+  next->state  = TASK_RUNNING;
+  next->cpu    = rq - rqs;
+  next->slice  = SCHED_SLICE;
+  rq->cur      = next;
+
+  this_cpu_write(cur, next == rq->idle ? 0 : next);
+  this_cpu_inc(nr_switches);
+
+  // Interrupts and system calls from user mode land on the task's stack
+  rq->pinfo->proc_tss.rsp[0] = (uintptr_t)next->kstack_top;
+  this_cpu_write(kstack_top, next->kstack_top);
+
+  // Returns once something switches back to prev, maybe on another
+  // processor, rq is stale from here
+  task *last = as_task_switch(&prev->ksp, next->ksp, prev);
+  switch_finish(last);
+}
+
+static void schedule() {
+  uint64_t  rflags = int_save();
+  sched_rq *rq     = this_rq();
+  task     *prev   = rq->cur;
+
+  // Nothing is held across a switch
+  rcu_quiescent();
+  rq->need_resched = false;
+
+  spin_lock(&rq->lock);
+  // Blocking tasks are off the queues, and one woken before it could
+  // switch out is queued again already
+  if (prev != rq->idle && prev->state == TASK_RUNNING) {
+    prev->state = TASK_PENDING;
+    rq_push(rq, prev);
+  }
+  task *next = rq_pop(rq);
+  spin_unlock(&rq->lock);
+
+  if (!next) {
+    next = rq_steal(rq);
+  }
+  if (!next) {
+    next = rq->idle;
+  }
+
+  if (next == prev) {
+    prev->state = TASK_RUNNING;
+  } else {
+    switch_to(rq, prev, next);
+  }
+
+  int_restore(rflags);
+}
+
+noreturn void sched_task_start(task *prev) {
+  switch_finish(prev);
+
+  task *cur = this_rq()->cur;
+  int_enable();
+  cur->entry(cur->arg);
+  sched_exit();
+}
+
+noreturn void sched_start() {
+  int_disable();
+
+  sched_rq *rq = this_rq();
+  rq->pinfo    = proc_getinfo();
+  rq->idle     = task_create_idle();
+  rq->cur      = rq->idle;
+
+  rq->idle->cpu        = rq - rqs;
+  rq->idle->kstack_top = rq->pinfo->ksatck;
+  __atomic_store_n(&rq->online, true, __ATOMIC_RELEASE);
+
+  // Every pass is an RCU quiescent state, interrupts are only enabled right
+  // before halting, sti delays them by an instruction so none can slip in
+  // between the two
+  while (true) {
+    int_disable();
+    rcu_quiescent();
+
+    // Whoever queues a task after this sees the flag and kicks us
+    rq->sleeping = true;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (rq->len || rq_busiest(rq)) {
+      rq->sleeping = false;
+      timer_tick_restart();
+      schedule();
+      continue;
+    }
+
+    // Without a tick, nothing but interrupts wakes us up, not even RCU, so
+    // the tick keeps going as long as our callbacks wait for grace periods
+    bool nohz = !rcu_needs_cpu() && timer_tick_stop();
+    if (nohz) {
+      rcu_idle_enter();
+    }
+    asm volatile("sti\n\thlt" ::: "memory");
+    int_disable();
+
+    rq->sleeping = false;
+    if (nohz) {
+      rcu_idle_exit();
+    }
+  }
+}
+
+void sched_add(task *t) {
+  // New tasks are taken as independent, and spread out: ties go to the
+  // least loaded package, then core, SMT siblings share execution units
+  sched_rq *best      = 0;
+  size_t    best_load = SIZE_MAX;
+  size_t    best_pkg  = SIZE_MAX;
+  size_t    best_core = SIZE_MAX;
+  for (size_t i = 0; i < PROC_MAX_COUNT; ++i) {
+    sched_rq *rq = rqs + i;
+    if (!rq->online) {
+      continue;
+    }
+
+    size_t load = rq_load(rq);
+    if (load > best_load) {
+      continue;
+    }
+    size_t pkg  = domain_load(i, TOPO_PKG);
+    size_t core = domain_load(i, TOPO_SMT);
+    if (load < best_load || pkg < best_pkg ||
+        (pkg == best_pkg && core < best_core)) {
+      best      = rq;
+      best_load = load;
+      best_pkg  = pkg;
+      best_core = core;
+    }
+  }
+  // Before any processor schedules, tasks wait on the caller's queue
+  if (!best) {
+    best = this_rq();
+  }
+
+  t->state        = TASK_PENDING;
+  uint64_t rflags = spin_lock_irqsave(&best->lock);
+  rq_push(best, t);
+  spin_unlock_irqrestore(&best->lock, rflags);
+  rq_kick(best, false);
+}
+
+void sched_add_on(task *t, size_t sysid) {
+  sched_rq *rq = rqs + sysid;
+
+  t->state        = TASK_PENDING;
+  t->pinned       = true;
+  uint64_t rflags = spin_lock_irqsave(&rq->lock);
+  rq_push(rq, t);
+  spin_unlock_irqrestore(&rq->lock, rflags);
+  rq_kick(rq, true);
+}
+
+void sched_yield() {
+  schedule();
+}
+
+void sched_cond_yield() {
+  if (this_rq()->need_resched) {
+    schedule();
+  }
+}
+
+noreturn void sched_exit() {
+  int_disable();
+  this_rq()->cur->state = TASK_ZOMBIE;
+  schedule();
+
+  // Never switched back to
+  __builtin_unreachable();
+}
+
+task *sched_current() {
+  // Kernel code is not preempted, so the processor cannot change under us
+  return this_cpu_read(cur);
+}
+
+void sched_block(volatile bool *woken) {
+  task *cur  = this_rq()->cur;
+  cur->state = TASK_BLOCKING;
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  // A wake up before the state was set left the task running, one after
+  // queued it again already, it then has to go through the queue
+  if (!*woken
+      || !__sync_bool_compare_and_swap(
+          &cur->state, TASK_BLOCKING, TASK_RUNNING
+      )) {
+    schedule();
+  }
+}
+
+bool sched_wake(task *t) {
+  if (!__sync_bool_compare_and_swap(&t->state, TASK_BLOCKING, TASK_PENDING)) {
+    return false;
+  }
+
+  // Back where it last ran, its cache may still be warm. If that one is
+  // busy, an idle processor sharing its last level cache takes it, or one
+  // sharing the waker's, the two likely work on the same data
+  sched_rq *rq     = rqs + t->cpu;
+  bool      pinned = t->pinned;
+  if (!pinned && !rq_isidle(rq)) {
+    sched_rq *near = rq_find_idle(t->cpu, TOPO_LLC, 0);
+    if (!near && sched_current()) {
+      near = rq_find_idle(this_rq() - rqs, TOPO_LLC, 0);
+    }
+    if (near) {
+      rq = near;
+    }
+  }
+  uint64_t rflags = spin_lock_irqsave(&rq->lock);
+  rq_push(rq, t);
+  spin_unlock_irqrestore(&rq->lock, rflags);
+  rq_kick(rq, pinned);
+  return true;
+}
+
+bool sched_tick(bool user) {
+  sched_rq *rq = this_rq();
+  if (!rq->online) {
+    return false;
+  }
+
+  // The idle loop looks at the queues by itself
+  task *cur = rq->cur;
+  if (cur == rq->idle) {
+    return false;
+  }
+
+  if (cur->slice > 1) {
+    --cur->slice;
+    return false;
+  }
+  // Nothing else to run here, the task keeps going for another slice
+  if (!rq->len) {
+    cur->slice = SCHED_SLICE;
+    return false;
+  }
+  if (!user) {
+    rq->need_resched = true;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,34 @@
+#include <semaphore.h>
+#include <string.h>
+
+void sem_init(semaphore *sem, int64_t count) {
+  memset(sem, 0, sizeof(*sem));
+  sem->count = count;
+}
+
+bool sem_trydown(semaphore *sem) {
+  int64_t count = __atomic_load_n(&sem->count, __ATOMIC_RELAXED);
+  while (count > 0) {
+    if (__atomic_compare_exchange_n(
+            &sem->count, &count, count - 1, true, __ATOMIC_ACQUIRE,
+            __ATOMIC_RELAXED
+        )) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void sem_down(semaphore *sem) {
+  while (!sem_trydown(sem)) {
+    wait_event(&sem->waiters, sem->count > 0);
+  }
+}
+
+void sem_up(semaphore *sem) {
+  // The locked add orders the count before the look at the queue
+  __sync_fetch_and_add(&sem->count, 1);
+  if (__atomic_load_n(&sem->waiters.head, __ATOMIC_RELAXED)) {
+    wake_up(&sem->waiters);
+  }
+}
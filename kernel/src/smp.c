@@ -0,0 +1,162 @@
+#include <apic.h>
+#include <interrupts.h>
+#include <mem.h>
+#include <proc.h>
+#include <rcu.h>
+#include <smp.h>
+#include <sys.h>
+#include <utils.h>
+
+#include <asm/ctlr.h>
+#include <asm/invlpg.h>
+
+static smp_cpu           smp_cpus[PROC_MAX_COUNT];
+static volatile cpu_mask online_cpus = 0;
+
+struct TLB_RANGE;
+typedef struct TLB_RANGE tlb_range;
+struct TLB_RANGE {
+  uintptr_t start;
+  uintptr_t end;
+};
+
+// Returns true if the queue was empty, the target has to be interrupted
+static bool call_push(smp_cpu *cpu, smp_call *call) {
+  smp_call *head = __atomic_load_n(&cpu->head, __ATOMIC_RELAXED);
+  do {
+    call->next = head;
+  } while (!__atomic_compare_exchange_n(
+      &cpu->head, &head, call, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED
+  ));
+  return !head;
+}
+
+static void call_flush(smp_cpu *cpu) {
+  smp_call *list = __atomic_exchange_n(&cpu->head, 0, __ATOMIC_ACQUIRE);
+  if (!list) {
+    return;
+  }
+
+  // Pushed newest first, they run in the order they were queued
+  smp_call *fifo = 0;
+  while (list) {
+    smp_call *next = list->next;
+    list->next     = fifo;
+    fifo           = list;
+    list           = next;
+  }
+
+  while (fifo) {
+    smp_call        *next = fifo->next;
+    smp_call_f       fn   = fifo->fn;
+    void            *arg  = fifo->arg;
+    volatile size_t *done = fifo->done;
+
+    // The slot can be reused by its owner from here
+    __atomic_store_n(&fifo->busy, false, __ATOMIC_RELEASE);
+
+    fn(arg);
+    if (done) {
+      __atomic_sub_fetch(done, 1, __ATOMIC_RELEASE);
+    }
+    fifo = next;
+  }
+}
+
+void smp_online() {
+  smp_cpu *cpu = smp_cpus + proc_sysid();
+  cpu->apicid  = proc_getid();
+  __atomic_or_fetch(&online_cpus, CPU_MASK_OF(proc_sysid()), __ATOMIC_RELEASE);
+}
+
+cpu_mask smp_online_mask() {
+  return __atomic_load_n(&online_cpus, __ATOMIC_ACQUIRE);
+}
+
+void smp_call_function(cpu_mask mask, smp_call_f fn, void *arg, bool wait) {
+  uint64_t rflags = int_save();
+  size_t   self   = proc_sysid();
+  smp_cpu *me     = smp_cpus + self;
+
+  cpu_mask        targets = mask & smp_online_mask() & ~CPU_MASK_OF(self);
+  volatile size_t done    = __builtin_popcountll(targets);
+
+  for (cpu_mask left = targets; left; left &= left - 1) {
+    size_t    sysid = __builtin_ctzll(left);
+    smp_call *slot  = me->slots + sysid;
+
+    // The previous call to this target has not been taken yet, ours may be
+    // the call it is waiting on to get to it
+    while (__atomic_load_n(&slot->busy, __ATOMIC_ACQUIRE)) {
+      call_flush(me);
+      pause();
+    }
+
+    slot->fn   = fn;
+    slot->arg  = arg;
+    slot->done = wait ? &done : 0;
+    slot->busy = true;
+
+    if (call_push(smp_cpus + sysid, slot)) {
+      apic_send_ipi(smp_cpus[sysid].apicid, APIC_CALL_VECTOR);
+    }
+  }
+
+  if (mask & CPU_MASK_OF(self)) {
+    fn(arg);
+  }
+
+  if (wait) {
+    while (__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+      call_flush(me);
+      pause();
+    }
+  }
+
+  int_restore(rflags);
+}
+
+void smp_call_poll() {
+  smp_cpu *cpu = smp_cpus + proc_sysid();
+  if (!__atomic_load_n(&cpu->head, __ATOMIC_RELAXED) || int_enabled()) {
+    return;
+  }
+  // Processors that are not registered still use sysid 0
+  if (proc_getinfo()) {
+    call_flush(cpu);
+  }
+}
+
+void smp_call_interrupt() {
+  // Calls may read RCU protected data, an idle processor has to take part
+  // in grace periods again first
+  rcu_idle_exit();
+  call_flush(smp_cpus + proc_sysid());
+}
+
+static void tlb_flush(void *arg) {
+  tlb_range *range = arg;
+
+  size_t pages = (range->end - range->start) / MEM_PS;
+  if (range->end <= (uintptr_t)KVMSPACE && pages > SMP_TLB_FLUSH_THRESHOLD) {
+    as_rlcr3();
+    return;
+  }
+
+  for (uintptr_t vadr = range->start; vadr < range->end; vadr += MEM_PS) {
+    as_invlpg(vadr);
+  }
+}
+
+void smp_tlb_shootdown(void *vadr, size_t size) {
+  tlb_range range = {
+      .start = ALIGN_DN((uintptr_t)vadr, MEM_PS),
+      .end   = ALIGN_UP((uintptr_t)vadr + size, MEM_PS),
+  };
+
+  // Kernel code is not preempted, the caller stays on this processor
+  cpu_mask others = smp_online_mask() & ~CPU_MASK_OF(proc_sysid());
+  if (others) {
+    smp_call_function(others, tlb_flush, &range, true);
+  }
+}
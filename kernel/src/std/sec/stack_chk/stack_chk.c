@@ -1,5 +1,4 @@
 #include <attributes.h>
-#include <mutex.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <sys.h>
@@ -18,9 +17,11 @@ uint8_t __stack_chk_stack[1024];
 // no error message being displayed If two cores stack smash at the same time,
 // and then both try to use the same stack while generating the error message,
 // we may not see any error message. Therefore, only the first of them that can
-// lock this mutex will be able to use the stack. We won't see that 2 or more
+// lock this flag will be able to use the stack. We won't see that 2 or more
 // cores stack smashed, but at least we would see that a stack smahing happened
-mutex __stack_chk_lock;
+// It is taken with a cmpxchg by __stack_chk_fail, it cannot be a lock
+// that uses the stack
+volatile uint32_t __stack_chk_lock;
 
 // This is called from assembly
 void __stack_chk_fail_p2() {
@@ -0,0 +1,74 @@
+#include <errno.h>
+#include <interrupts.h>
+#include <stdlib.h>
+#include <utils.h>
+
+#include "internal_stdlib.h"
+
+void *i_stdlib_aligned_alloc(size_t align, size_t size) {
+  // aligned_alloc(). Units are always 16 bytes aligned, so smaller alignments
+  // are a plain malloc. Alignments of a page or more, and sizes that are
+  // large allocations anyway, are given to the large allocation path, which
+  // can align its reservations to anything
+  // Other alignments over allocate a unit, and cut it in two at the first
+  // aligned address that leaves room for a unit in front of it, that front
+  // unit is freed right away, and what is after the requested size is split
+  // off as usual
+
+  if (!size) {
+    return 0;
+  }
+
+  if (align & (align - 1)) {
+    errno = EINVAL;
+    return 0;
+  }
+
+  if (align <= 16) {
+    return i_stdlib_malloc(size);
+  }
+
+  if (align >= MEM_PS || size >= LARGE_ALLOC_MIN) {
+    return i_stdlib_large_alloc(size, align);
+  }
+
+  size = ALIGN_UP(size, 16);
+  if (size < UNIT_MIN_SIZE) {
+    size = UNIT_MIN_SIZE;
+  }
+
+  void *ptr = i_stdlib_malloc(size + align + UNIT_SPLIT_DELTA);
+  if (!ptr || IS_LARGE(ptr)) {
+    // Large allocations are page aligned
+    return ptr;
+  }
+
+  uint64_t     rflags = int_save();
+  heap_state  *heap   = i_stdlib_this_heap();
+  unit_header *unit   = PTR_UNIT(ptr);
+
+  if ((uintptr_t)ptr % align) {
+    void *aligned = (void *)ALIGN_UP((uintptr_t)ptr + UNIT_SPLIT_DELTA, align);
+
+    unit_header *aligned_unit = PTR_UNIT(aligned);
+    aligned_unit->size        = UNIT_SIZE(unit) - (aligned - ptr);
+    aligned_unit->block       = unit->block;
+
+    unit->size = (aligned - ptr - UNIT_HEADER_SIZE) | (unit->size & UNITF_MASK);
+    i_stdlib_free_unit(heap, unit);
+
+    unit = aligned_unit;
+    ptr  = aligned;
+  }
+
+  i_stdlib_unit_split(heap, unit, size);
+
+  int_restore(rflags);
+  return ptr;
+}
+
+void *aligned_alloc(size_t align, size_t size) {
+  void *ptr = i_stdlib_aligned_alloc(align, size);
+  i_stdlib_profile_alloc(ptr, size, __builtin_return_address(0));
+  return ptr;
+}
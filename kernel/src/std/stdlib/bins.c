@@ -0,0 +1,84 @@
+#include <stdint.h>
+#include <utils.h>
+
+#include "internal_stdlib.h"
+
+size_t i_stdlib_bin_index(size_t size) {
+  if (size <= SMALL_BIN_MAX) {
+    return size / 16 - 1;
+  }
+
+  // Every power of two is split into four bins, starting with the one of
+  // SMALL_BIN_MAX
+  size_t msb   = 63 - __builtin_clzll(size);
+  size_t index = SMALL_BIN_COUNT + (msb - 10) * 4 + ((size >> (msb - 2)) & 3);
+
+  return index < BIN_COUNT ? index : BIN_COUNT - 1;
+}
+
+void i_stdlib_bin_insert(heap_state *heap, unit_header *unit) {
+  size_t index = i_stdlib_bin_index(UNIT_SIZE(unit));
+
+  unit->fprev = 0;
+  unit->fnext = heap->bins[index];
+  if (unit->fnext) {
+    unit->fnext->fprev = unit;
+  }
+
+  heap->bins[index]          = unit;
+  heap->bin_map[index / 64] |= (uint64_t)1 << (index % 64);
+}
+
+void i_stdlib_bin_remove(heap_state *heap, unit_header *unit) {
+  size_t index = i_stdlib_bin_index(UNIT_SIZE(unit));
+
+  if (unit->fnext) {
+    unit->fnext->fprev = unit->fprev;
+  }
+
+  if (unit->fprev) {
+    unit->fprev->fnext = unit->fnext;
+  } else {
+    heap->bins[index] = unit->fnext;
+    if (!unit->fnext) {
+      heap->bin_map[index / 64] &= ~((uint64_t)1 << (index % 64));
+    }
+  }
+
+  unit->fnext = 0;
+  unit->fprev = 0;
+}
+
+unit_header *i_stdlib_bin_find(heap_state *heap, size_t size) {
+  size_t index = i_stdlib_bin_index(size);
+
+  // Small bins hold units of exactly one size, large bins hold a range
+  // of sizes so some of their units might be too small
+  if (index < SMALL_BIN_COUNT) {
+    if (heap->bins[index]) {
+      return heap->bins[index];
+    }
+  } else {
+    unit_header *unit = heap->bins[index];
+    for (size_t i = 0; unit && i < LARGE_BIN_SCAN; ++i, unit = unit->fnext) {
+      if (UNIT_SIZE(unit) >= size) {
+        return unit;
+      }
+    }
+  }
+
+  // Any unit of a larger bin is large enough, take the first unit of
+  // the first non empty one
+  for (size_t i = (index + 1) / 64; i < BIN_COUNT / 64; ++i) {
+    uint64_t map = heap->bin_map[i];
+    if (i == (index + 1) / 64) {
+      map &= UINT64_MAX << ((index + 1) % 64);
+    }
+
+    if (map) {
+      return heap->bins[i * 64 + FFS(map)];
+    }
+  }
+
+  return 0;
+}
@@ -1,3 +1,4 @@
+#include <lock.h>
 #include <mem.h>
 #include <stdio.h>
 #include <string.h>
@@ -8,12 +9,18 @@
 
 #include "../src/mem/internal_mem.h"
 
-block_header *i_stdlib_alloc_block(size_t size) {
+// Heaps of all processors share the same virtual range, the heaps only call
+// in here with interrupts disabled
+static spinlock block_lock = {0};
+
+block_header *i_stdlib_alloc_block(heap_state *heap, size_t size) {
   // The requested size does not take into account that we need to allcoate
   // slightly more for the block header itself
   size += sizeof(block_header);
 
+  spin_lock(&block_lock);
   mem_vseg seg = mem_alloc_vblock(size, MAPF_R | MAPF_W, KHEAP, KHEAP_SIZE);
+  spin_unlock(&block_lock);
 
   if (seg.error) {
     return 0;
@@ -25,19 +32,50 @@ block_header *i_stdlib_alloc_block(size_t size) {
   memset(header, 0, sizeof(*header));
   header->magic      = BLOCK_MAGIC;
   header->block_size = size;
+  header->heap       = heap;
+
+  // Setup the first unit, and the fence after it
+  unit_header *funit = BLOCK_FUNIT(header);
 
-  // Setup the first unit
-  unit_header *funit = (unit_header *)(header + 1);
-  memset(funit, 0, sizeof(*funit));
-  funit->magic = UNIT_MAGIC;
-  funit->size  = size - sizeof(block_header) - sizeof(unit_header);
+  funit->size  = size - sizeof(block_header) - 2 * UNIT_HEADER_SIZE;
   funit->block = header;
-  funit->flags = UNITF_FREE;
 
-  header->ffunit            = funit;
-  header->largest_free      = funit;
-  header->largest_free_size = funit->size;
+  unit_header *fence = UNIT_NEXT(funit);
+
+  fence->size  = 0;
+  fence->block = header;
+
+  i_stdlib_unit_mark_free(funit);
+
+  // Link the block in the heap, and bin its unit
+  header->next = heap->blocks;
+  if (header->next) {
+    header->next->prev = header;
+  }
+  heap->blocks = header;
+
+  i_stdlib_bin_insert(heap, funit);
+  ++heap->empty_blocks;
 
   // Done :)
   return header;
 }
+
+void i_stdlib_free_block(block_header *block) {
+  heap_state *heap = block->heap;
+
+  if (block->next) {
+    block->next->prev = block->prev;
+  }
+  if (block->prev) {
+    block->prev->next = block->next;
+  } else {
+    heap->blocks = block->next;
+  }
+
+  block->magic = 0;
+
+  spin_lock(&block_lock);
+  mem_free_vblock(block, block->block_size);
+  spin_unlock(&block_lock);
+}
@@ -1,11 +1,14 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "internal_stdlib.h"
+
 void *calloc(size_t nmemb, size_t size) {
   // TODO: I assume there is no integer
   // oveflow happening from the multiplication
   // is it even worth fixing?
-  void *ptr = malloc(nmemb * size);
+  void *ptr = i_stdlib_malloc(nmemb * size);
+  i_stdlib_profile_alloc(ptr, nmemb * size, __builtin_return_address(0));
   if (ptr) {
     memset(ptr, 0, nmemb * size);
   }
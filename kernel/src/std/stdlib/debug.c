@@ -1,44 +1,96 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys.h>
 
 #include "internal_stdlib.h"
 
-void i_stdlib_malloc_print_state() {
+static void print_heap(heap_state *heap) {
   size_t        block_count   = 0;
-  block_header *current_block = i_stdlib_heap_header;
+  block_header *current_block = heap->blocks;
 
   while (current_block) {
-    printd(
-        "Block #%lu (%lz) [ffunit=%p]:\n",
-        block_count,
-        current_block->block_size,
-        current_block->ffunit
-    );
+    printd("Block #%lu (%lz):\n", block_count, current_block->block_size);
 
     unit_header *current_unit = BLOCK_FUNIT(current_block);
     size_t       unit_count   = 0;
-    while (current_unit) {
+    while (UNIT_SIZE(current_unit)) {
       printd(
-          "\tUnit #%lu (%lz) [%p]", unit_count, current_unit->size, current_unit
+          "\tUnit #%lu (%lz) [%p]",
+          unit_count,
+          UNIT_SIZE(current_unit),
+          current_unit
       );
 
-      if (current_unit->flags & UNITF_FREE) {
+      if (current_unit->size & UNITF_FREE) {
         printd(
-            " F[fprev=%p,fnext=%p]", current_unit->fprev, current_unit->fnext
+            " F[bin=%lu,fprev=%p,fnext=%p]",
+            i_stdlib_bin_index(UNIT_SIZE(current_unit)),
+            current_unit->fprev,
+            current_unit->fnext
         );
       }
-      if (current_unit->size == current_block->largest_free_size) {
-        printd(" X");
-      }
-      if (current_unit == current_block->largest_free) {
-        printd(" U");
-      }
 
       printd("\n");
       ++unit_count;
-      current_unit = current_unit->next;
+      current_unit = UNIT_NEXT(current_unit);
     }
     ++block_count;
     current_block = current_block->next;
   }
+
+  for (size_t i = 0; i < BIN_COUNT; ++i) {
+    size_t count = 0;
+    for (unit_header *u = heap->bins[i]; u; u = u->fnext) {
+      ++count;
+    }
+
+    if (count) {
+      printd("Bin #%lu: %lu free units\n", i, count);
+    }
+  }
+}
+
+void i_stdlib_malloc_print_state() {
+  for (size_t i = 0; i < PROC_MAX_COUNT; ++i) {
+    if (i_stdlib_heaps[i].blocks) {
+      printd("Heap of processor #%lu:\n", i);
+      print_heap(i_stdlib_heaps + i);
+    }
+  }
+}
+
+void malloc_bench(size_t rounds) {
+  // Synthetic workload, keeps up to 256 live allocations, most of them small
+  // with the odd large one, and randomly frees, allocates and grows them
+  static void *ptrs[256];
+
+  uint64_t seed   = 0x2545F4914F6CDD1D;
+  uint64_t cycles = 0;
+
+  for (size_t i = 0; i < rounds; ++i) {
+    seed        = seed * 6364136223846793005 + 1442695040888963407;
+    size_t slot = (seed >> 33) % 256;
+    size_t size = (seed >> 17) % 8 ? 16 + (seed >> 41) % 496
+                                   : 4096 + (seed >> 41) % (60 * 1024);
+
+    uint64_t start = rdtsc();
+    if (!ptrs[slot]) {
+      ptrs[slot] = malloc(size);
+    } else if ((seed >> 13) % 4) {
+      free(ptrs[slot]);
+      ptrs[slot] = 0;
+    } else {
+      ptrs[slot] = realloc(ptrs[slot], size);
+    }
+    cycles += rdtsc() - start;
+  }
+
+  for (size_t i = 0; i < 256; ++i) {
+    free(ptrs[i]);
+    ptrs[i] = 0;
+  }
+
+  printd(
+      "malloc bench: %lu operations, %lu cycles/op\n", rounds, cycles / rounds
+  );
 }
@@ -0,0 +1,60 @@
+#include <proc.h>
+
+#include "internal_stdlib.h"
+
+heap_state *i_stdlib_this_heap() {
+  heap_state *heap = i_stdlib_heaps + proc_sysid();
+
+  if (heap->remote_free) {
+    unit_header *unit = __sync_lock_test_and_set(&heap->remote_free, 0);
+    while (unit) {
+      unit_header *next = unit->fnext;
+      i_stdlib_free_unit(heap, unit);
+      unit = next;
+    }
+  }
+
+  return heap;
+}
+
+void i_stdlib_free_unit(heap_state *heap, unit_header *unit) {
+  // Merge with next unit if it is free, the fence at the end of the block is
+  // never free
+  unit_header *next = UNIT_NEXT(unit);
+  if (next->size & UNITF_FREE) {
+    i_stdlib_bin_remove(heap, next);
+    i_stdlib_unit_absorb(unit);
+  }
+
+  // Merge with previous unit if it is free, it is found through its footer
+  if (unit->size & UNITF_PREV_FREE) {
+    unit = UNIT_PREV(unit);
+
+    i_stdlib_bin_remove(heap, unit);
+    i_stdlib_unit_absorb(unit);
+  }
+
+  i_stdlib_unit_mark_free(unit);
+
+  // The whole block is free, keep it for later if we do not have enough
+  // empty blocks already, otherwise give it back
+  if (UNIT_ALONE(unit)) {
+    if (heap->empty_blocks >= HEAP_EMPTY_BLOCKS) {
+      i_stdlib_free_block(unit->block);
+      return;
+    }
+    ++heap->empty_blocks;
+  }
+
+  i_stdlib_bin_insert(heap, unit);
+}
+
+void i_stdlib_remote_free(unit_header *unit) {
+  heap_state *owner = unit->block->heap;
+
+  unit_header *head;
+  do {
+    head        = owner->remote_free;
+    unit->fnext = head;
+  } while (!__sync_bool_compare_and_swap(&owner->remote_free, head, unit));
+}
@@ -3,8 +3,10 @@
 
 #include "internal_stdlib.h"
 
-block_header *i_stdlib_heap_header = 0;
+heap_state i_stdlib_heaps[PROC_MAX_COUNT] = {0};
 
 void __init_stdlib() {
-  i_stdlib_heap_header = i_stdlib_alloc_block(INITIAL_HEAP_SIZE);
+  // Heaps of the other processors get their first block on their first
+  // allocation
+  i_stdlib_alloc_block(i_stdlib_this_heap(), INITIAL_HEAP_SIZE);
 }
@@ -1,8 +1,11 @@
 #ifndef CSTD_INT_STDLIB_H
 #define CSTD_INT_STDLIB_H
 
+#include <attributes.h>
 #include <mem.h>
+#include <proc.h>
 #include <stddef.h>
+#include <stdint.h>
 
 struct BLOCK_HEADER;
 typedef struct BLOCK_HEADER block_header;
@@ -10,60 +13,190 @@ typedef struct BLOCK_HEADER block_header;
 struct UNIT_HEADER;
 typedef struct UNIT_HEADER unit_header;
 
+struct HEAP_STATE;
+typedef struct HEAP_STATE heap_state;
+
 #define BLOCK_MAGIC (0x08EA9A770CB70C20)
-#define UNIT_MAGIC (0x08EA9A770C541770)
 
 #define INITIAL_HEAP_SIZE (8 * 1024 * 1024)
 
+// How many completely free blocks a heap keeps around before giving them
+// back
+#define HEAP_EMPTY_BLOCKS (2)
+
+// Free units are kept in size segregated bins, units of up to SMALL_BIN_MAX
+// bytes have a bin per exact size, larger units are put in bins that each
+// cover a quarter of a power of two, the last bin takes everything that is
+// too large for the others
+#define SMALL_BIN_COUNT (64)
+#define SMALL_BIN_MAX (SMALL_BIN_COUNT * 16)
+#define LARGE_BIN_COUNT (64)
+#define BIN_COUNT (SMALL_BIN_COUNT + LARGE_BIN_COUNT)
+
+// How many units of a large bin malloc looks at before giving up on that bin
+// and taking the first unit of a larger bin
+#define LARGE_BIN_SCAN (16)
+
+// Allocations of at least LARGE_ALLOC_MIN bytes are not made from the heaps,
+// they get pages of their own in KHEAP_LARGE, with no header in front, and
+// LARGE_HEADROOM times their size of virtual space to grow into, so realloc
+// maps pages instead of copying bytes
+#define LARGE_ALLOC_MIN (MEM_PS)
+#define LARGE_HEADROOM (2)
+
+#define IS_LARGE(p)                                                            \
+  (KHEAP_LARGE <= (void *)(p) && (void *)(p) < KHEAP_LARGE + KHEAP_LARGE_SIZE)
+
+// Block headers are 16 bytes aligned so that units, and the memory they
+// hand out, are as well
 struct BLOCK_HEADER {
   size_t magic;  // Verify that the pointer is indeed a block header
 
   size_t block_size;  // Block size, header counted
 
-  unit_header *ffunit;  // First free unit
-  unit_header *largest_free;
-  size_t       largest_free_size;
+  heap_state *heap;  // Heap of the processor that allocated the block
 
   block_header *next;
   block_header *prev;
-};
-
+} __attribute__((aligned(16)));
+
+// Units are laid out back to back in their block, and the last unit of a
+// block is followed by a fence unit of size 0 that is never free
+// A free unit also has a copy of its size in its last 8 bytes(footer), which
+// lets the unit after it find it, that unit has UNITF_PREV_FREE set
+// fnext and fprev are only there while the unit is free, they take the first
+// bytes of the memory the unit hands out when it is allocated
 struct UNIT_HEADER {
-  size_t magic;  // Verify that the pointer is indeed a unit header
-
   size_t size;  // Size, of bytes that this unit controls, not counting the
-                // bytes the header itself takes
-
-  size_t flags;
+                // bytes the header itself takes, the low 4 bits are flags
 
   block_header *block;
 
-  unit_header *fnext;
+  unit_header *fnext;  // Next free unit in the same bin
   unit_header *fprev;
-
-  unit_header *next;
-  unit_header *prev;
 };
 
+// Every processor has a heap of its own, only that processor ever touches
+// its blocks, bins and units, with interrupts disabled
+// Units freed by other processors are pushed on remote_free instead, which
+// the owner drains the next time it uses its heap
+struct HEAP_STATE {
+  block_header *blocks;
+  size_t        empty_blocks;  // Blocks whose only unit is free
+
+  unit_header *bins[BIN_COUNT];
+  uint64_t     bin_map[BIN_COUNT / 64];  // Bit set for every non empty bin
+
+  unit_header *volatile remote_free;  // Linked through fnext
+} cache_aligned;
+
 #define UNITF_FREE (1 << 1)
+#define UNITF_PREV_FREE (1 << 2)
+#define UNITF_SAMPLED (1 << 3)  // Recorded by the heap profiler
+#define UNITF_MASK (0xF)
+
+// Bytes a unit header takes in front of the memory it hands out
+#define UNIT_HEADER_SIZE (offsetof(unit_header, fnext))
+
+// A unit should be able to hold its free list links and its footer
+#define UNIT_MIN_SIZE (32)
 
 // Returns a pointer to the first unit header in of the block
 #define BLOCK_FUNIT(b) ((unit_header *)((b) + 1))
 
-#define UNIT_PTR(u) ((void *)((u) + 1))
-#define PTR_UNIT(p) ((unit_header *)(p)-1)
+#define UNIT_SIZE(u) ((u)->size & ~(size_t)UNITF_MASK)
+
+#define UNIT_PTR(u) ((void *)(u) + UNIT_HEADER_SIZE)
+#define PTR_UNIT(p) ((unit_header *)((void *)(p)-UNIT_HEADER_SIZE))
 
-#define UNIT_SPLIT_DELTA (sizeof(unit_header) + 32)
+// The unit right after u in memory, the fence if u is the last one
+#define UNIT_NEXT(u) ((unit_header *)(UNIT_PTR(u) + UNIT_SIZE(u)))
+#define UNIT_FOOTER(u) ((size_t *)UNIT_NEXT(u) - 1)
+// The unit right before u in memory, only valid if it is free
+#define UNIT_PREV(u) (PTR_UNIT((void *)(u) - *((size_t *)(u)-1)))
+
+// Checks if the unit is the only one in its block
+#define UNIT_ALONE(u)                                                          \
+  ((u) == BLOCK_FUNIT((u)->block) && !UNIT_SIZE(UNIT_NEXT(u)))
+
+#define UNIT_SPLIT_DELTA (UNIT_HEADER_SIZE + UNIT_MIN_SIZE)
 
 // Allocates a number of pages from Kernel heap and assigns them to the block
 // returned
-// This new block should be integrated in the linked list by the caller function
-// The block header is zeroed, and the magic number is placed
-block_header *i_stdlib_alloc_block(size_t size);
-
-extern block_header *i_stdlib_heap_header;
+// The block is linked into the heap, and its only unit is free and binned
+block_header *i_stdlib_alloc_block(heap_state *heap, size_t size);
+
+// Unlinks a block from its heap, and gives its pages back to the VMM/PMM
+// The only unit of the block should be free and out of its bin
+void i_stdlib_free_block(block_header *block);
+
+// Returns the heap of the calling processor, after freeing the units other
+// processors gave back to it
+// Interrupts should be disabled for as long as the heap is used
+heap_state *i_stdlib_this_heap();
+
+// Frees a unit of heap, merging it with its free neighbours
+void i_stdlib_free_unit(heap_state *heap, unit_header *unit);
+
+// Gives a unit back to the heap that owns it, from another processor
+void i_stdlib_remote_free(unit_header *unit);
+
+// Returns the bin a free unit of size bytes belongs to
+size_t i_stdlib_bin_index(size_t size);
+
+void i_stdlib_bin_insert(heap_state *heap, unit_header *unit);
+void i_stdlib_bin_remove(heap_state *heap, unit_header *unit);
+
+// Returns a free unit of at least size bytes, or 0 if no bin has one
+// The unit is left in its bin
+unit_header *i_stdlib_bin_find(heap_state *heap, size_t size);
+
+// Shrinks unit to size bytes if what is left is large enough to make a unit
+// of its own, that new free unit is merged with the next unit if it is free
+// and then binned
+void i_stdlib_unit_split(heap_state *heap, unit_header *unit, size_t size);
+
+// Merges the unit just after unit into it, the caller should have taken that
+// unit out of its bin
+void i_stdlib_unit_absorb(unit_header *unit);
+
+// Sets or clears the free flag of unit, and keeps its footer and the
+// UNITF_PREV_FREE flag of the next unit in sync
+void i_stdlib_unit_mark_free(unit_header *unit);
+void i_stdlib_unit_mark_used(unit_header *unit);
+
+// Large allocations, ptr is always the start of a large allocation, realloc
+// keeps the allocation large, size should be at least LARGE_ALLOC_MIN
+// The allocation is aligned to align, or to a page if that is larger
+void *i_stdlib_large_alloc(size_t size, size_t align);
+void  i_stdlib_large_free(void *ptr);
+void *i_stdlib_large_realloc(void *ptr, size_t size);
+
+// malloc, free and realloc without the profiler hooks, for use by the heap
+// functions themselves
+void *i_stdlib_malloc(size_t size);
+void  i_stdlib_free(void *ptr);
+void *i_stdlib_realloc(void *ptr, size_t size, void *site);
+void *i_stdlib_aligned_alloc(size_t align, size_t size);
+
+// Heap profiler hooks, site is the address the allocation was made from
+#ifdef HELIUM_PROFILE_HEAP
+void i_stdlib_profile_alloc(void *ptr, size_t size, void *site);
+void i_stdlib_profile_free(void *ptr);
+// i_stdlib_profile_free in two steps, for realloc: the sample is found
+// while the allocation is still there, and dropped once it is really gone
+size_t i_stdlib_profile_find(void *ptr);
+void   i_stdlib_profile_drop(size_t sample);
+#else
+#define i_stdlib_profile_alloc(ptr, size, site)
+#define i_stdlib_profile_free(ptr)
+#define i_stdlib_profile_find(ptr) ((size_t)0)
+#define i_stdlib_profile_drop(sample) ((void)(sample))
+#endif
+
+extern heap_state i_stdlib_heaps[PROC_MAX_COUNT];
 
 // Debug
 void i_stdlib_malloc_print_state();
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,336 @@
+#include <errno.h>
+#include <interrupts.h>
+#include <kmem.h>
+#include <lock.h>
+#include <mem.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <utils.h>
+
+#include "internal_stdlib.h"
+
+/*
+  Large allocations. Every large allocation reserves a range of KHEAP_LARGE
+  LARGE_HEADROOM times its size, only the pages it uses are mapped. Growing
+  maps more pages at its end, if the reservation is too small it is extended
+  with the free range right after it, or the pages are moved to a new
+  reservation with mem_vmove, never copied.
+  The ranges are described out of line, so the allocation itself starts on
+  a page boundary, or a larger alignment it was asked for, and has no header
+  sharing its pages.
+*/
+
+struct LARGE_RANGE;
+typedef struct LARGE_RANGE large_range;
+struct LARGE_RANGE {
+  void  *base;
+  size_t size;
+
+  size_t mapped;  // Allocations only, bytes mapped from base
+  size_t align;   // Allocations only, alignment of base, kept when moved
+
+  large_range *next;   // Free ranges only, ordered by address
+  large_range *prev;
+  large_range *hnext;  // Allocations only, next in the bucket
+};
+
+// Buckets of the allocations, by start address. The table is fixed, growing
+// it would allocate under large_lock, from malloc, which can land here
+#define LARGE_BUCKETS (256)
+
+// Protects everything below
+static spinlock large_lock = {0};
+
+static kmem_cache  *range_cache = 0;
+static large_range *free_ranges = 0;
+static large_range *allocs[LARGE_BUCKETS];
+
+static bool large_init() {
+  if (range_cache) {
+    return true;
+  }
+
+  kmem_cache *cache =
+      kmem_cache_create("large_range", sizeof(large_range), 0, 0);
+  if (!cache) {
+    return false;
+  }
+
+  large_range *range = kmem_cache_alloc(cache);
+  if (!range) {
+    return false;
+  }
+  range->base = KHEAP_LARGE;
+  range->size = KHEAP_LARGE_SIZE;
+  range->next = 0;
+  range->prev = 0;
+
+  free_ranges = range;
+  range_cache = cache;
+  return true;
+}
+
+static large_range **alloc_bucket(void *base) {
+  return allocs + ((uintptr_t)base / MEM_PS) % LARGE_BUCKETS;
+}
+
+static void alloc_insert(large_range *alloc) {
+  large_range **bucket = alloc_bucket(alloc->base);
+
+  alloc->hnext = *bucket;
+  *bucket      = alloc;
+}
+
+// Finds the allocation starting at base, and takes it out of its bucket if
+// remove is set
+static large_range *alloc_search(void *base, bool remove) {
+  large_range **link = alloc_bucket(base);
+  while (*link && (*link)->base != base) {
+    link = &(*link)->hnext;
+  }
+
+  large_range *alloc = *link;
+  if (alloc && remove) {
+    *link = alloc->hnext;
+  }
+  return alloc;
+}
+
+static void range_unlink(large_range *range) {
+  if (range->next) {
+    range->next->prev = range->prev;
+  }
+  if (range->prev) {
+    range->prev->next = range->next;
+  } else {
+    free_ranges = range->next;
+  }
+  kmem_cache_free(range_cache, range);
+}
+
+// Takes size bytes from the front of a free range
+static void *range_take(large_range *range, size_t size) {
+  void *base = range->base;
+
+  range->base += size;
+  range->size -= size;
+  if (!range->size) {
+    range_unlink(range);
+  }
+  return base;
+}
+
+// Gives a virtual range back, merging it with the free ranges around it
+static void vspace_release(void *base, size_t size) {
+  large_range *prev = 0;
+  large_range *next = free_ranges;
+  while (next && next->base < base) {
+    prev = next;
+    next = next->next;
+  }
+
+  if (prev && prev->base + prev->size == base) {
+    prev->size += size;
+    if (next && prev->base + prev->size == next->base) {
+      prev->size += next->size;
+      range_unlink(next);
+    }
+    return;
+  }
+
+  if (next && base + size == next->base) {
+    next->base  = base;
+    next->size += size;
+    return;
+  }
+
+  large_range *range = kmem_cache_alloc(range_cache);
+  if (!range) {
+    // The range is lost, it is only virtual space
+    return;
+  }
+  range->base = base;
+  range->size = size;
+  range->prev = prev;
+  range->next = next;
+
+  if (next) {
+    next->prev = range;
+  }
+  if (prev) {
+    prev->next = range;
+  } else {
+    free_ranges = range;
+  }
+}
+
+// Returns the start of a free virtual range of size bytes aligned to align,
+// first fit
+static void *vspace_reserve(size_t size, size_t align) {
+  for (large_range *range = free_ranges; range; range = range->next) {
+    void *base = (void *)ALIGN_UP((uintptr_t)range->base, align);
+    void *end  = range->base + range->size;
+    if (base >= end || (size_t)(end - base) < size) {
+      continue;
+    }
+
+    if (base == range->base) {
+      return range_take(range, size);
+    }
+
+    // What is before base stays in this range, what is after it gets a
+    // range of its own
+    range->size = base - range->base;
+    if (base + size < end) {
+      vspace_release(base + size, end - (base + size));
+    }
+    return base;
+  }
+  return 0;
+}
+
+// Reserves the size bytes right after end, if they are free
+static bool vspace_extend(void *end, size_t size) {
+  large_range *range = free_ranges;
+  while (range && range->base < end) {
+    range = range->next;
+  }
+
+  if (!range || range->base != end || range->size < size) {
+    return false;
+  }
+  range_take(range, size);
+  return true;
+}
+
+void *i_stdlib_large_alloc(size_t size, size_t align) {
+  size_t mapped = ALIGN_UP(size, MEM_PS);
+  if (align < MEM_PS) {
+    align = MEM_PS;
+  }
+
+  uint64_t rflags = spin_lock_irqsave(&large_lock);
+
+  large_range *alloc = 0;
+  if (large_init()) {
+    alloc = kmem_cache_alloc(range_cache);
+  }
+
+  void *base = alloc ? vspace_reserve(mapped * LARGE_HEADROOM, align) : 0;
+  if (!base) {
+    if (alloc) {
+      kmem_cache_free(range_cache, alloc);
+    }
+    spin_unlock_irqrestore(&large_lock, rflags);
+    errno = ENOMEM;
+    return 0;
+  }
+
+  alloc->base   = base;
+  alloc->size   = mapped * LARGE_HEADROOM;
+  alloc->mapped = mapped;
+  alloc->align  = align;
+
+  if (!mem_alloc_into(base, mapped, MAPF_R | MAPF_W)) {
+    vspace_release(base, alloc->size);
+    kmem_cache_free(range_cache, alloc);
+    spin_unlock_irqrestore(&large_lock, rflags);
+    errno = ENOMEM;
+    return 0;
+  }
+  alloc_insert(alloc);
+
+  spin_unlock_irqrestore(&large_lock, rflags);
+  return base;
+}
+
+void i_stdlib_large_free(void *ptr) {
+  uint64_t rflags = spin_lock_irqsave(&large_lock);
+
+  large_range *alloc = alloc_search(ptr, true);
+  if (!alloc) {
+    spin_unlock_irqrestore(&large_lock, rflags);
+    printd("free(): Pointer invalid\n");
+    return;
+  }
+
+  mem_free_vblock(alloc->base, alloc->mapped);
+  vspace_release(alloc->base, alloc->size);
+  kmem_cache_free(range_cache, alloc);
+
+  spin_unlock_irqrestore(&large_lock, rflags);
+}
+
+void *i_stdlib_large_realloc(void *ptr, size_t size) {
+  // Shrinking unmaps the pages past the new end, the reservation is kept
+  // Growing maps new pages past the old end, when they do not fit in the
+  // reservation it is extended in place if the range after it is free,
+  // otherwise the mapped pages are moved to a new reservation. The new pages
+  // are mapped before anything is moved, a failed realloc leaves the
+  // allocation as it was
+
+  size_t mapped = ALIGN_UP(size, MEM_PS);
+
+  uint64_t rflags = spin_lock_irqsave(&large_lock);
+
+  large_range *alloc = alloc_search(ptr, false);
+  if (!alloc) {
+    spin_unlock_irqrestore(&large_lock, rflags);
+    printd("realloc(): Pointer invalid\n");
+    return 0;
+  }
+
+  if (mapped <= alloc->mapped) {
+    if (mapped < alloc->mapped) {
+      mem_free_vblock(alloc->base + mapped, alloc->mapped - mapped);
+      alloc->mapped = mapped;
+    }
+    spin_unlock_irqrestore(&large_lock, rflags);
+    return ptr;
+  }
+
+  void  *base    = alloc->base;
+  size_t reserve = mapped * LARGE_HEADROOM;
+  if (mapped > alloc->size) {
+    if (vspace_extend(alloc->base + alloc->size, reserve - alloc->size)) {
+      alloc->size = reserve;
+    } else {
+      base = vspace_reserve(reserve, alloc->align);
+      if (!base) {
+        spin_unlock_irqrestore(&large_lock, rflags);
+        errno = ENOMEM;
+        return 0;
+      }
+    }
+  }
+
+  if (!mem_alloc_into(
+          base + alloc->mapped, mapped - alloc->mapped, MAPF_R | MAPF_W
+      )) {
+    if (base != alloc->base) {
+      vspace_release(base, reserve);
+    }
+    spin_unlock_irqrestore(&large_lock, rflags);
+    errno = ENOMEM;
+    return 0;
+  }
+
+  if (base != alloc->base) {
+    if (mem_vmove(base, alloc->base, alloc->mapped, MAPF_R | MAPF_W)) {
+      error_inv_state("Could not move large allocation");
+    }
+
+    alloc_search(alloc->base, true);
+    vspace_release(alloc->base, alloc->size);
+
+    alloc->base = base;
+    alloc->size = reserve;
+    alloc_insert(alloc);
+  }
+  alloc->mapped = mapped;
+
+  void *new_ptr = alloc->base;
+
+  spin_unlock_irqrestore(&large_lock, rflags);
+  return new_ptr;
+}
@@ -0,0 +1,19 @@
+#include <errno.h>
+#include <stdlib.h>
+
+#include "internal_stdlib.h"
+
+int posix_memalign(void **memptr, size_t align, size_t size) {
+  if (align < sizeof(void *) || (align & (align - 1))) {
+    return EINVAL;
+  }
+
+  void *ptr = i_stdlib_aligned_alloc(align, size);
+  i_stdlib_profile_alloc(ptr, size, __builtin_return_address(0));
+  if (!ptr && size) {
+    return ENOMEM;
+  }
+
+  *memptr = ptr;
+  return 0;
+}
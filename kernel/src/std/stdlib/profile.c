@@ -0,0 +1,244 @@
+#ifdef HELIUM_PROFILE_HEAP
+
+#include <interrupts.h>
+#include <lock.h>
+#include <proc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys.h>
+
+#include "internal_stdlib.h"
+
+/*
+  Allocation site profiler. Allocations are sampled, about one every
+  PROFILE_RATE allocated bytes, a sampled allocation smaller than that stands
+  for PROFILE_RATE / size allocations of its size, so the numbers printed are
+  estimations. Only sampled allocations take the profiler lock.
+*/
+
+#define PROFILE_RATE (64 * 1024)
+#define PROFILE_SITES (1024)
+#define PROFILE_SAMPLES (8192)
+#define PROFILE_HIST (16)  // Power of two size classes, 16 bytes and up
+
+#define SAMPLE_TOMBSTONE ((void *)1)
+
+struct PROFILE_SITE;
+typedef struct PROFILE_SITE profile_site;
+struct PROFILE_SITE {
+  void *site;
+
+  size_t alloc_count;
+  size_t alloc_bytes;
+  size_t live_count;
+  size_t live_bytes;
+
+  size_t hist[PROFILE_HIST];
+};
+
+struct PROFILE_SAMPLE;
+typedef struct PROFILE_SAMPLE profile_sample;
+struct PROFILE_SAMPLE {
+  void  *ptr;
+  size_t size;
+  size_t weight;
+  size_t site;  // Index in sites
+};
+
+static spinlock       profile_lock = {0};
+static profile_site   sites[PROFILE_SITES];
+static profile_sample samples[PROFILE_SAMPLES];
+static size_t         dropped = 0;  // Samples that found no room
+
+// Bytes left to allocate before the next sample, per processor
+static size_t countdown[PROC_MAX_COUNT];
+
+static size_t hash_ptr(void *ptr) {
+  return ((uintptr_t)ptr >> 4) * 0x9E3779B97F4A7C15 >> 32;
+}
+
+static size_t hist_class(size_t size) {
+  size_t class = 63 - __builtin_clzll(size) - 4;
+  return class < PROFILE_HIST ? class : PROFILE_HIST - 1;
+}
+
+// Returns the index of the site, or PROFILE_SITES if the table is full
+static size_t find_site(void *site) {
+  size_t idx = hash_ptr(site) % PROFILE_SITES;
+  for (size_t i = 0; i < PROFILE_SITES; ++i, idx = (idx + 1) % PROFILE_SITES) {
+    if (sites[idx].site == site) {
+      return idx;
+    }
+    if (!sites[idx].site) {
+      sites[idx].site = site;
+      return idx;
+    }
+  }
+  return PROFILE_SITES;
+}
+
+void i_stdlib_profile_alloc(void *ptr, size_t size, void *site) {
+  if (!ptr) {
+    return;
+  }
+
+  uint64_t rflags = int_save();
+  size_t  *left   = countdown + proc_sysid();
+
+  if (size < *left) {
+    *left -= size;
+    int_restore(rflags);
+    return;
+  }
+  // Some jitter, so allocation patterns do not line up with the rate
+  *left = PROFILE_RATE / 2 + rdtsc() % PROFILE_RATE;
+
+  size_t weight = size < PROFILE_RATE ? PROFILE_RATE / size : 1;
+
+  spin_lock(&profile_lock);
+
+  size_t site_idx = find_site(site);
+  size_t idx      = hash_ptr(ptr) % PROFILE_SAMPLES;
+  size_t i        = 0;
+  for (; i < PROFILE_SAMPLES; ++i, idx = (idx + 1) % PROFILE_SAMPLES) {
+    if (!samples[idx].ptr || samples[idx].ptr == SAMPLE_TOMBSTONE) {
+      break;
+    }
+  }
+
+  if (site_idx == PROFILE_SITES || i == PROFILE_SAMPLES) {
+    ++dropped;
+  } else {
+    samples[idx].ptr    = ptr;
+    samples[idx].size   = size;
+    samples[idx].weight = weight;
+    samples[idx].site   = site_idx;
+
+    profile_site *s = sites + site_idx;
+    s->alloc_count += weight;
+    s->alloc_bytes += weight * size;
+    s->live_count  += weight;
+    s->live_bytes  += weight * size;
+
+    s->hist[hist_class(size)] += weight;
+
+    // Large allocations have no unit, they are always looked up
+    if (!IS_LARGE(ptr)) {
+      PTR_UNIT(ptr)->size |= UNITF_SAMPLED;
+    }
+  }
+
+  spin_unlock_irqrestore(&profile_lock, rflags);
+}
+
+// Returns the index of the sample of ptr, PROFILE_SAMPLES if it has none,
+// under the profiler lock
+static size_t find_sample(void *ptr) {
+  size_t idx = hash_ptr(ptr) % PROFILE_SAMPLES;
+  for (size_t i = 0; i < PROFILE_SAMPLES && samples[idx].ptr;
+       ++i, idx = (idx + 1) % PROFILE_SAMPLES) {
+    if (samples[idx].ptr == ptr) {
+      return idx;
+    }
+  }
+  return PROFILE_SAMPLES;
+}
+
+// The allocation of the sample is gone, under the profiler lock
+static void drop_sample(size_t idx) {
+  if (idx == PROFILE_SAMPLES) {
+    return;
+  }
+
+  profile_site *s = sites + samples[idx].site;
+  s->live_count -= samples[idx].weight;
+  s->live_bytes -= samples[idx].weight * samples[idx].size;
+
+  samples[idx].ptr = SAMPLE_TOMBSTONE;
+}
+
+void i_stdlib_profile_free(void *ptr) {
+  if (!ptr || (!IS_LARGE(ptr) && !(PTR_UNIT(ptr)->size & UNITF_SAMPLED))) {
+    return;
+  }
+
+  uint64_t rflags = spin_lock_irqsave(&profile_lock);
+  drop_sample(find_sample(ptr));
+  spin_unlock_irqrestore(&profile_lock, rflags);
+}
+
+size_t i_stdlib_profile_find(void *ptr) {
+  if (!ptr || (!IS_LARGE(ptr) && !(PTR_UNIT(ptr)->size & UNITF_SAMPLED))) {
+    return PROFILE_SAMPLES;
+  }
+
+  uint64_t rflags = spin_lock_irqsave(&profile_lock);
+  size_t   idx    = find_sample(ptr);
+  spin_unlock_irqrestore(&profile_lock, rflags);
+  return idx;
+}
+
+void i_stdlib_profile_drop(size_t sample) {
+  if (sample == PROFILE_SAMPLES) {
+    return;
+  }
+
+  uint64_t rflags = spin_lock_irqsave(&profile_lock);
+  drop_sample(sample);
+  spin_unlock_irqrestore(&profile_lock, rflags);
+}
+
+void malloc_profile_dump() {
+  static size_t order[PROFILE_SITES];
+
+  uint64_t rflags = spin_lock_irqsave(&profile_lock);
+
+  // Sites are printed by decreasing live bytes
+  size_t count = 0;
+  for (size_t i = 0; i < PROFILE_SITES; ++i) {
+    if (!sites[i].alloc_count) {
+      continue;
+    }
+
+    size_t j = count++;
+    for (; j && sites[order[j - 1]].live_bytes < sites[i].live_bytes; --j) {
+      order[j] = order[j - 1];
+    }
+    order[j] = i;
+  }
+
+  printd(
+      "Heap profile: %lu sites, a sample every ~%lz, %lu samples dropped\n",
+      count,
+      (size_t)PROFILE_RATE,
+      dropped
+  );
+
+  for (size_t i = 0; i < count; ++i) {
+    profile_site *s = sites + order[i];
+
+    printd(
+        "%p: live %lu (%lz), allocated %lu (%lz)\n\t",
+        s->site,
+        s->live_count,
+        s->live_bytes,
+        s->alloc_count,
+        s->alloc_bytes
+    );
+    for (size_t j = 0; j < PROFILE_HIST; ++j) {
+      if (s->hist[j]) {
+        printd(" %lz:%lu", (size_t)16 << j, s->hist[j]);
+      }
+    }
+    printd("\n");
+  }
+
+  spin_unlock_irqrestore(&profile_lock, rflags);
+}
+
+#else
+
+void malloc_profile_dump() {}
+
+#endif
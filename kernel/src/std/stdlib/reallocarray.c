@@ -1,8 +1,10 @@
 #include <stdlib.h>
 
+#include "internal_stdlib.h"
+
 void *reallocarray(void *ptr, size_t nmemb, size_t size) {
   // TODO: I assume there is no integer
   // oveflow happening from the multiplication
   // is it even worth fixing?
-  return realloc(ptr, nmemb * size);
+  return i_stdlib_realloc(ptr, nmemb * size, __builtin_return_address(0));
 }
\ No newline at end of file
@@ -0,0 +1,37 @@
+#include "internal_stdlib.h"
+
+void i_stdlib_unit_split(heap_state *heap, unit_header *unit, size_t size) {
+  if (size + UNIT_SPLIT_DELTA > UNIT_SIZE(unit)) {
+    return;
+  }
+
+  unit_header *new_unit = UNIT_PTR(unit) + size;
+
+  new_unit->size  = UNIT_SIZE(unit) - size - UNIT_HEADER_SIZE;
+  new_unit->block = unit->block;
+  unit->size      = size | (unit->size & UNITF_MASK);
+
+  unit_header *next = UNIT_NEXT(new_unit);
+  if (next->size & UNITF_FREE) {
+    i_stdlib_bin_remove(heap, next);
+    i_stdlib_unit_absorb(new_unit);
+  }
+
+  i_stdlib_unit_mark_free(new_unit);
+  i_stdlib_bin_insert(heap, new_unit);
+}
+
+void i_stdlib_unit_absorb(unit_header *unit) {
+  unit->size += UNIT_HEADER_SIZE + UNIT_SIZE(UNIT_NEXT(unit));
+}
+
+void i_stdlib_unit_mark_free(unit_header *unit) {
+  unit->size |= UNITF_FREE;
+  *UNIT_FOOTER(unit) = UNIT_SIZE(unit);
+  UNIT_NEXT(unit)->size |= UNITF_PREV_FREE;
+}
+
+void i_stdlib_unit_mark_used(unit_header *unit) {
+  unit->size &= ~(size_t)(UNITF_FREE | UNITF_SAMPLED);
+  UNIT_NEXT(unit)->size &= ~(size_t)UNITF_PREV_FREE;
+}
@@ -0,0 +1,77 @@
+#include <error.h>
+#include <kmem.h>
+#include <proc.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <task.h>
+
+#include <asm/task.h>
+
+static kmem_cache       *task_cache = 0;
+static spinlock          cache_lock = {0};
+static volatile uint64_t next_id    = 0;
+
+static task *task_alloc() {
+  if (!task_cache) {
+    spin_lock(&cache_lock);
+    if (!task_cache) {
+      task_cache = kmem_cache_create("task", sizeof(task), 16, 0);
+    }
+    spin_unlock(&cache_lock);
+  }
+
+  task *t = kmem_cache_alloc(task_cache);
+  if (!t) {
+    return 0;
+  }
+  memset(t, 0, sizeof(*t));
+  t->id = __sync_fetch_and_add(&next_id, 1);
+  return t;
+}
+
+task *task_create(task_entry_f entry, void *arg) {
+  task *t = task_alloc();
+  if (!t) {
+    return 0;
+  }
+
+  t->kstack = aligned_alloc(KSTACK_SIZE, KSTACK_SIZE);
+  if (!t->kstack) {
+    kmem_cache_free(task_cache, t);
+    return 0;
+  }
+  t->kstack_top = t->kstack + KSTACK_SIZE;
+  t->entry      = entry;
+  t->arg        = arg;
+  t->state      = TASK_BLOCKING;
+
+  // The first switch to the task pops zeroed callee saved registers and
+  // returns to as_task_start, the slot above keeps the stack aligned as if
+  // it had been called
+  uint64_t *sp = t->kstack_top;
+  *--sp        = 0;
+  *--sp        = (uintptr_t)as_task_start;
+  for (size_t i = 0; i < AS_TASK_SAVED_REGS; ++i) {
+    *--sp = 0;
+  }
+  t->ksp = sp;
+
+  return t;
+}
+
+task *task_create_idle() {
+  task *t = task_alloc();
+  if (!t) {
+    error_out_of_memory("Could not allocate idle task");
+  }
+
+  t->state  = TASK_RUNNING;
+  t->on_cpu = true;
+  return t;
+}
+
+void task_destroy(task *t) {
+  free(t->kstack);
+  kmem_cache_free(task_cache, t);
+}
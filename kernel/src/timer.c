@@ -0,0 +1,138 @@
+#include <apic.h>
+#include <clock.h>
+#include <interrupts.h>
+#include <proc.h>
+#include <rcu.h>
+#include <stdint.h>
+#include <sys.h>
+#include <timer.h>
+
+static timer_cpu timer_cpus[PROC_MAX_COUNT];
+
+static uint64_t now_ticks() {
+  uint64_t ticks, tsc;
+  clock_read(&ticks, &tsc);
+  return ticks;
+}
+
+// Without a calibrated TSC, the bus frequency is a guess under hypervisors
+static uint32_t timer_calibrate() {
+  uint64_t hz = clock_tsc_hz();
+  if (!hz) {
+    return proc_bus_freq() * 1000;
+  }
+
+  uint64_t cycles = hz / 1000 * TIMER_CALIBRATE_TICKS;
+  apic_timer_set(APIC_TIMER_ONESHOT, UINT32_MAX);
+  uint64_t start = rdtsc();
+  while (rdtsc() - start < cycles) {
+    pause();
+  }
+  uint32_t elapsed = UINT32_MAX - apic_timer_count();
+
+  return elapsed / TIMER_CALIBRATE_TICKS;
+}
+
+void timer_init() {
+  timer_cpu *tc  = timer_cpus + proc_sysid();
+  tc->tick_count = timer_calibrate();
+  apic_timer_set(APIC_TIMER_PERIODIC, tc->tick_count);
+}
+
+void ktimer_add(ktimer *t, uint64_t ticks, ktimer_f fn, void *arg) {
+  t->fn       = fn;
+  t->arg      = arg;
+  t->deadline = now_ticks() + (ticks ? ticks : 1);
+
+  uint64_t   rflags = int_save();
+  timer_cpu *tc     = timer_cpus + proc_sysid();
+  t->cpu            = tc - timer_cpus;
+
+  spin_lock(&tc->lock);
+  ktimer **link = &tc->head;
+  while (*link && (*link)->deadline <= t->deadline) {
+    link = &(*link)->next;
+  }
+  t->next   = *link;
+  *link     = t;
+  t->queued = true;
+  spin_unlock(&tc->lock);
+
+  // Called from an interrupt on an idle processor, the idle loop programs
+  // the new deadline before halting again
+  int_restore(rflags);
+}
+
+bool ktimer_cancel(ktimer *t) {
+  timer_cpu *tc     = timer_cpus + t->cpu;
+  uint64_t   rflags = spin_lock_irqsave(&tc->lock);
+
+  bool queued = t->queued;
+  if (queued) {
+    ktimer **link = &tc->head;
+    while (*link != t) {
+      link = &(*link)->next;
+    }
+    *link     = t->next;
+    t->queued = false;
+  }
+
+  spin_unlock_irqrestore(&tc->lock, rflags);
+  return queued;
+}
+
+void timer_interrupt() {
+  // Callbacks may read RCU protected data, an idle processor has to take
+  // part in grace periods again first
+  rcu_idle_exit();
+
+  timer_cpu *tc  = timer_cpus + proc_sysid();
+  uint64_t   now = now_ticks();
+
+  spin_lock(&tc->lock);
+  while (tc->head && tc->head->deadline <= now) {
+    ktimer *t = tc->head;
+    tc->head  = t->next;
+    t->queued = false;
+
+    // The callback may add the timer again
+    spin_unlock(&tc->lock);
+    t->fn(t->arg);
+    spin_lock(&tc->lock);
+  }
+  spin_unlock(&tc->lock);
+}
+
+bool timer_tick_stop() {
+  if (proc_isprimary()) {
+    return false;
+  }
+
+  timer_cpu *tc = timer_cpus + proc_sysid();
+
+  spin_lock(&tc->lock);
+  uint64_t count = 0;
+  if (tc->head) {
+    uint64_t now   = now_ticks();
+    uint64_t delta = tc->head->deadline > now ? tc->head->deadline - now : 1;
+
+    // Deadlines past what the counter can hold take a few wake ups
+    count = delta * tc->tick_count;
+    if (count > UINT32_MAX) {
+      count = UINT32_MAX;
+    }
+  }
+  apic_timer_set(APIC_TIMER_ONESHOT, count);
+  tc->tick_stopped = true;
+  spin_unlock(&tc->lock);
+
+  return true;
+}
+
+void timer_tick_restart() {
+  timer_cpu *tc = timer_cpus + proc_sysid();
+  if (tc->tick_stopped) {
+    tc->tick_stopped = false;
+    apic_timer_set(APIC_TIMER_PERIODIC, tc->tick_count);
+  }
+}
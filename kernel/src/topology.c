@@ -0,0 +1,158 @@
+#include <cpuid.h>
+#include <lock.h>
+#include <proc.h>
+#include <stdio.h>
+#include <topology.h>
+
+static topo_cpu topo_cpus[PROC_MAX_COUNT];
+static spinlock topo_lock = {0};
+
+// Bits needed to tell n IDs apart
+static uint32_t id_bits(uint32_t n) {
+  uint32_t bits = 0;
+  while (bits < 32 && ((uint32_t)1 << bits) < n) {
+    ++bits;
+  }
+  return bits;
+}
+
+// Splits the x2APIC ID with leaf 0x1F, or 0xB, returns false if neither is
+// there. The shift of the last level gives the package ID
+static bool topo_extended(
+    uint32_t *x2apicid, uint32_t *smt_shift, uint32_t *pkg_shift
+) {
+  static uint32_t const leaves[] = {0x1F, 0xB};
+
+  uint32_t a, b, c, d;
+  for (size_t i = 0; i < sizeof(leaves) / sizeof(*leaves); ++i) {
+    uint32_t leaf = leaves[i];
+    if (__get_cpuid_max(0, 0) < leaf) {
+      continue;
+    }
+    __cpuid_count(leaf, 0, a, b, c, d);
+    if (!b) {  // No processors at the first level, not implemented
+      continue;
+    }
+
+    // Every subleaf reports the x2APIC ID, even when subleaf 0 is the end
+    *x2apicid  = d;
+    *smt_shift = 0;
+    *pkg_shift = 0;
+    for (uint32_t sub = 0; sub < 8; ++sub) {
+      __cpuid_count(leaf, sub, a, b, c, d);
+      uint32_t type = (c >> 8) & 0xFF;
+      if (!type) {
+        break;
+      }
+      if (type == 1) {  // SMT
+        *smt_shift = a & 0x1F;
+      }
+      *pkg_shift = a & 0x1F;
+    }
+    return true;
+  }
+  return false;
+}
+
+// Only the number of logical processors in the package is known, they are
+// taken as cores
+static void topo_legacy(
+    uint32_t *x2apicid, uint32_t *smt_shift, uint32_t *pkg_shift
+) {
+  uint32_t a, b, c, d;
+  __cpuid(1, a, b, c, d);
+
+  *x2apicid  = b >> 24;
+  *smt_shift = 0;
+  *pkg_shift = d & (1 << 28) ? id_bits((b >> 16) & 0xFF) : 0;
+}
+
+// Bits under the ID of the last level cache, from the cache of the highest
+// level described by the deterministic cache leaf
+static uint32_t topo_llc_shift(uint32_t pkg_shift) {
+  uint32_t a, b, c, d;
+  uint32_t leaf = 0;
+
+  if (__get_cpuid_max(0, 0) >= 4) {
+    __cpuid_count(4, 0, a, b, c, d);
+    leaf = a & 0x1F ? 4 : 0;
+  }
+  // AMD, with topology extensions
+  if (!leaf && __get_cpuid_max(0x80000000, 0) >= 0x8000001D) {
+    __cpuid(0x80000001, a, b, c, d);
+    leaf = c & (1 << 22) ? 0x8000001D : 0;
+  }
+  if (!leaf) {
+    return pkg_shift;
+  }
+
+  uint32_t level = 0;
+  uint32_t shift = pkg_shift;
+  for (uint32_t sub = 0; sub < 16; ++sub) {
+    __cpuid_count(leaf, sub, a, b, c, d);
+    if (!(a & 0x1F)) {  // No more caches
+      break;
+    }
+    if (((a >> 5) & 0x7) > level) {
+      level = (a >> 5) & 0x7;
+      shift = id_bits(((a >> 14) & 0xFFF) + 1);
+    }
+  }
+  return shift < pkg_shift ? shift : pkg_shift;
+}
+
+void topo_init() {
+  uint32_t x2apicid, smt_shift, pkg_shift;
+  if (!topo_extended(&x2apicid, &smt_shift, &pkg_shift)) {
+    topo_legacy(&x2apicid, &smt_shift, &pkg_shift);
+  }
+  uint32_t llc_shift = topo_llc_shift(pkg_shift);
+
+  size_t    sysid = proc_sysid();
+  topo_cpu *cpu   = topo_cpus + sysid;
+  cpu->x2apicid   = x2apicid;
+  cpu->core_id    = x2apicid >> smt_shift;
+  cpu->llc_id     = x2apicid >> llc_shift;
+  cpu->pkg_id     = x2apicid >> pkg_shift;
+
+  // The higher bits are in every ID, processors with equal IDs at a level
+  // share it, domains only ever grow
+  spin_lock(&topo_lock);
+  cpu->online = true;
+  for (size_t i = 0; i < PROC_MAX_COUNT; ++i) {
+    topo_cpu *other = topo_cpus + i;
+    if (!other->online) {
+      continue;
+    }
+
+    bool shared[TOPO_LEVELS] = {
+        [TOPO_SMT] = other->core_id == cpu->core_id,
+        [TOPO_LLC] = other->llc_id == cpu->llc_id,
+        [TOPO_PKG] = other->pkg_id == cpu->pkg_id,
+        [TOPO_ALL] = true,
+    };
+    for (size_t level = 0; level < TOPO_LEVELS; ++level) {
+      if (shared[level]) {
+        __atomic_or_fetch(
+            &cpu->domains[level], CPU_MASK_OF(i), __ATOMIC_RELAXED
+        );
+        __atomic_or_fetch(
+            &other->domains[level], CPU_MASK_OF(sysid), __ATOMIC_RELAXED
+        );
+      }
+    }
+  }
+  spin_unlock(&topo_lock);
+
+  printd(
+      "[Proc %&] x2APIC ID: %u, core: %u, LLC: %u, package: %u\n",
+      x2apicid,
+      cpu->core_id,
+      cpu->llc_id,
+      cpu->pkg_id
+  );
+}
+
+cpu_mask topo_domain(size_t sysid, topo_level level) {
+  return __atomic_load_n(&topo_cpus[sysid].domains[level], __ATOMIC_RELAXED);
+}
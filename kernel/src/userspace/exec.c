@@ -1,4 +1,5 @@
 #include <elf.h>
+#include <error.h>
 #include <initrd.h>
 #include <mem.h>
 #include <stdio.h>
@@ -53,7 +54,9 @@ void exec() {
         ALIGN_UP(ph->mem_size + (uintptr_t)vadr - (uintptr_t)vadr_base, 0x1000);
     // size_t effective_size = ph->mem_size;
 
-    mem_alloc_into(vadr_base, real_size, flags);
+    if (!mem_alloc_into(vadr_base, real_size, flags)) {
+      error_out_of_memory("Could not map the program");
+    }
     memset(vadr_base, 0, real_size);
     memcpy(vadr, (void *)exec_file + ph->offset, ph->file_size);
 
@@ -61,6 +64,10 @@ void exec() {
   }
 
   // Allocate stack
-  mem_alloc_into(USPACE_STACK_TOP, USPACE_STACK_SIZE, MAPF_W | MAPF_R | MAPF_U);
+  if (!mem_alloc_into(
+          USPACE_STACK_TOP, USPACE_STACK_SIZE, MAPF_W | MAPF_R | MAPF_U
+      )) {
+    error_out_of_memory("Could not map the program stack");
+  }
   as_call_userspace((void *)exec_file->entrypoint, USPACE_STACK_BASE, 0x200);
 }
\ No newline at end of file
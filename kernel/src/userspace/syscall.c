@@ -1,49 +1,116 @@
 #include <mem.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <kterm.h>
+#include <kthread.h>
 #include <sys.h>
 #include <userspace.h>
 #include <interrupts.h>
+#include <lock.h>
+#include <proc.h>
+#include <rcu.h>
+#include <sched.h>
+
+// Every system call takes the five arguments, used or not
+#define SYSCALL_ARGS                                                           \
+  uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4
+
+typedef uint64_t (*syscall_f)(SYSCALL_ARGS);
+
+static uint64_t sys_exit(SYSCALL_ARGS) {
+  printd("Exiting program with status code: %lu\n", a0);
+  sched_exit();
+}
+
+static uint64_t sys_print(SYSCALL_ARGS) {
+  if (a0 < (uintptr_t)KVMSPACE) {  // No printing kernel memory lol
+    puts((char *)a0);
+  }
+  return 0;
+}
+
+static uint64_t sys_gets(SYSCALL_ARGS) {
+  if (a0 < (uintptr_t)KVMSPACE) {
+    return kterm_read((void *)a0, a1);
+  }
+  return 0;
+}
+
+static uint64_t sys_dbg(SYSCALL_ARGS) {
+  if (a0 < (uintptr_t)KVMSPACE) {
+    printd("%s", a0);
+  }
+  return 0;
+}
+
+static uint64_t sys_clear(SYSCALL_ARGS) {
+  kterm_clear();
+  return 0;
+}
+
+static uint64_t sys_kcfg(SYSCALL_ARGS) {
+  kterm_setfg(a0, a1, a2);
+  return 0;
+}
+
+static uint64_t sys_kcbg(SYSCALL_ARGS) {
+  kterm_setbg(a0, a1, a2);
+  return 0;
+}
+
+static uint64_t sys_lockstat(SYSCALL_ARGS) {
+  // Printed on the debug console, empty unless built with PROFILE=LOCK
+  lock_stat_dump();
+  if (a0) {
+    lock_stat_reset();
+  }
+  return 0;
+}
+
+static uint64_t sys_ctxbench(SYSCALL_ARGS) {
+  // Also printed on the debug console
+  kthread_bench();
+  return 0;
+}
+
+static uint64_t sys_mallocbench(SYSCALL_ARGS) {
+  // Also printed on the debug console
+  malloc_bench(MALLOC_BENCH_ROUNDS);
+  return 0;
+}
+
+static uint64_t sys_nop(SYSCALL_ARGS) {
+  return 0;
+}
+
+// Indexed by the number minus SYSCALL_FIRST, the numbers have no holes
+static syscall_f const syscall_table[SYSCALL_COUNT] = {
+    [SYSCALL_EXIT - SYSCALL_FIRST]        = sys_exit,
+    [SYSCALL_PRINT - SYSCALL_FIRST]       = sys_print,
+    [SYSCALL_GETS - SYSCALL_FIRST]        = sys_gets,
+    [SYSCALL_DBG - SYSCALL_FIRST]         = sys_dbg,
+    [SYSCALL_CLEAR - SYSCALL_FIRST]       = sys_clear,
+    [SYSCALL_KCFG - SYSCALL_FIRST]        = sys_kcfg,
+    [SYSCALL_KCBG - SYSCALL_FIRST]        = sys_kcbg,
+    [SYSCALL_LOCKSTAT - SYSCALL_FIRST]    = sys_lockstat,
+    [SYSCALL_CTXBENCH - SYSCALL_FIRST]    = sys_ctxbench,
+    [SYSCALL_NOP - SYSCALL_FIRST]         = sys_nop,
+    [SYSCALL_MALLOCBENCH - SYSCALL_FIRST] = sys_mallocbench,
+};
 
 uint64_t syscall(
-    uint64_t rdi,
-    uint64_t rsi,
-    uint64_t rdx,
-    uint64_t rcx,
-    uint8_t  r8,
-    uint64_t r9
+    uint64_t num, uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3,
+    uint64_t a4
 ) {
-  switch (rdi) {
-    case SYSCALL_EXIT:
-      printd("Exiting program with status code: %lu\n", rsi);
-      as_event_loop();
-    case SYSCALL_PRINT:
-      if (rsi < (uintptr_t)KVMSPACE) {  // No printing kernel memory lol
-        puts((char *)rsi);
-      }
-      return 0;
-    case SYSCALL_DBG:
-      if(rsi < (uintptr_t)KVMSPACE) {
-        printd("%s", rsi);
-      }
-      return 0;
-    case SYSCALL_GETS:
-      if(rsi < (uintptr_t)KVMSPACE) {
-        return kterm_read((void *)rsi, rdx);
-      }
-      return 0;
-    case SYSCALL_CLEAR:
-      kterm_clear();
-      return 0;
-    case SYSCALL_KCFG:
-      kterm_setfg(rsi, rdx, rcx);
-      return 0;
-    case SYSCALL_KCBG:
-      kterm_setbg(rsi, rdx, rcx);
-      return 0;
-    default:
-      printd("Unknown system call: %lx\n", rdi);
-      as_event_loop();
+  // Coming from user mode, nothing can be held from an RCU read side section
+  rcu_quiescent();
+  this_cpu_inc(nr_syscalls);
+
+  uint64_t idx = num - SYSCALL_FIRST;
+  if (idx >= SYSCALL_COUNT) {
+    printd("Unknown system call: %lx\n", num);
+    sched_exit();
   }
-}
\ No newline at end of file
+  return syscall_table[idx](a0, a1, a2, a3, a4);
+}
@@ -0,0 +1,138 @@
+#include <env.h>
+#include <interrupts.h>
+#include <rcu.h>
+#include <sched.h>
+#include <sys.h>
+#include <wait.h>
+
+// -1 until the first wait looked it up
+static volatile int has_mwait = -1;
+
+// Both with the queue locked
+static void entry_queue(wait_queue *wq, wait_entry *entry) {
+  entry->next   = 0;
+  entry->prev   = wq->tail;
+  entry->queued = true;
+
+  if (wq->tail) {
+    wq->tail->next = entry;
+  } else {
+    wq->head = entry;
+  }
+  wq->tail = entry;
+}
+
+static void entry_unqueue(wait_queue *wq, wait_entry *entry) {
+  if (entry->next) {
+    entry->next->prev = entry->prev;
+  } else {
+    wq->tail = entry->prev;
+  }
+  if (entry->prev) {
+    entry->prev->next = entry->next;
+  } else {
+    wq->head = entry->next;
+  }
+  entry->queued = false;
+}
+
+// The waiter cannot leave wait_event before the queue is unlocked, so the
+// entry and its task stay valid until then
+static void entry_wake(wait_queue *wq, wait_entry *entry) {
+  entry_unqueue(wq, entry);
+  __atomic_store_n(&entry->woken, true, __ATOMIC_RELEASE);
+  if (entry->task) {
+    sched_wake(entry->task);
+  }
+}
+
+uint64_t wait_prepare(wait_queue *wq, wait_entry *entry) {
+  uint64_t rflags = int_save();
+
+  spin_lock(&wq->lock);
+  entry->woken = false;
+  entry->task  = sched_current();
+  entry_queue(wq, entry);
+  spin_unlock(&wq->lock);
+
+  // Orders the queueing before the look at the condition, wakers change the
+  // condition before looking at the queue
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  return rflags;
+}
+
+void wait_block(wait_queue *wq, wait_entry *entry, uint64_t rflags) {
+  bool can_halt = rflags & (1 << 9);
+
+  if (has_mwait < 0) {
+    has_mwait = env_hasmwait();
+  }
+  if (can_halt) {
+    // Nothing can be held from a read side section while waiting
+    rcu_quiescent();
+  }
+
+  if (can_halt && entry->task) {
+    // Only the task sleeps, the processor goes on with other tasks
+    sched_block(&entry->woken);
+  } else if (has_mwait) {
+    // Any write to the flag's line wakes us up, the check after arming the
+    // monitor catches a wake up that came right before
+    asm volatile("monitor" ::"a"(&entry->woken), "c"(0), "d"(0));
+    if (!entry->woken) {
+      if (can_halt) {
+        asm volatile("sti\n\tmwait" ::"a"(0), "c"(0) : "memory");
+      } else {
+        asm volatile("mwait" ::"a"(0), "c"(0) : "memory");
+      }
+    }
+  } else if (!can_halt) {
+    pause();
+  } else if (!entry->woken) {
+    // sti only takes effect after hlt, so no interrupt is handled in
+    // between, a wake up from another processor is only seen on the next
+    // interrupt
+    asm volatile("sti\n\thlt" ::: "memory");
+  }
+  int_disable();
+
+  spin_lock(&wq->lock);
+  entry->woken = false;
+  if (!entry->queued) {
+    entry_queue(wq, entry);
+  }
+  spin_unlock(&wq->lock);
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void wait_finish(wait_queue *wq, wait_entry *entry, uint64_t rflags) {
+  spin_lock(&wq->lock);
+  if (entry->queued) {
+    entry_unqueue(wq, entry);
+  }
+  spin_unlock(&wq->lock);
+
+  int_restore(rflags);
+}
+
+void wake_up(wait_queue *wq) {
+  uint64_t rflags = spin_lock_irqsave(&wq->lock);
+
+  wait_entry *entry = wq->head;
+  if (entry) {
+    entry_wake(wq, entry);
+  }
+
+  spin_unlock_irqrestore(&wq->lock, rflags);
+}
+
+void wake_up_all(wait_queue *wq) {
+  uint64_t rflags = spin_lock_irqsave(&wq->lock);
+
+  while (wq->head) {
+    entry_wake(wq, wq->head);
+  }
+
+  spin_unlock_irqrestore(&wq->lock, rflags);
+}
@@ -7,9 +7,25 @@
 void *malloc(size_t size);
 void *calloc(size_t nmemb, size_t size);
 
+// align should be a power of two, posix_memalign also wants it to be a
+// multiple of sizeof(void *)
+void *aligned_alloc(size_t align, size_t size);
+int   posix_memalign(void **memptr, size_t align, size_t size);
+
 void *realloc(void *ptr, size_t size);
 void *reallocarray(void *ptr, size_t nmemb, size_t size);
 
 void free(void *ptr);
 
+// Prints per allocation site live bytes, allocation counts and size
+// histograms on the debug console, does nothing unless the kernel is built
+// with PROFILE=HEAP
+void malloc_profile_dump();
+
+#define MALLOC_BENCH_ROUNDS (100000)
+
+// Times a synthetic mix of malloc, free and realloc on the calling
+// processor's heap, prints the cycles per operation on the debug console
+void malloc_bench(size_t rounds);
+
 #endif
\ No newline at end of file
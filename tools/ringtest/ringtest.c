@@ -0,0 +1,193 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <dts/ring.h>
+
+/*
+  Host stress test and throughput run of the kernel rings, built from the
+  kernel sources with the host compiler and pthreads.
+  Every producer pushes its ID in the high bits and a sequence number in
+  the low ones. Consumers check that the elements of every producer come to
+  them in order, and the elements taken by all consumers are counted so
+  that each has to be seen exactly once.
+*/
+
+#define RING_CAP (1024)
+#define ITEMS (2000000)  // Per producer
+#define MAX_THREADS (16)
+
+#define ITEM(producer, seq) ((uint64_t)(producer) << 40 | (seq))
+#define ITEM_PRODUCER(item) ((item) >> 40)
+#define ITEM_SEQ(item) ((item) & (((uint64_t)1 << 40) - 1))
+
+typedef enum RING_KIND {
+  RING_MPMC,  // dts_ring_push and dts_ring_pop
+  RING_MPSC,  // dts_ring_push and dts_ring_pop_single
+  RING_SPSC,  // dts_spsc_ring
+} ring_kind;
+
+typedef struct RING_TEST ring_test;
+struct RING_TEST {
+  ring_kind      kind;
+  dts_ring      *ring;
+  dts_spsc_ring *spsc;
+  size_t         producers;
+  size_t         consumers;
+
+  volatile size_t taken;  // Elements popped by all consumers
+  volatile bool   failed;
+  uint8_t        *seen;  // Times every element was popped
+};
+
+typedef struct RING_THREAD ring_thread;
+struct RING_THREAD {
+  ring_test *test;
+  size_t     id;
+  pthread_t  thread;
+};
+
+static bool ring_push(ring_test *test, uint64_t item) {
+  if (test->kind == RING_SPSC) {
+    return dts_spsc_ring_push(test->spsc, &item);
+  }
+  return dts_ring_push(test->ring, &item);
+}
+
+static bool ring_pop(ring_test *test, uint64_t *item) {
+  switch (test->kind) {
+  case RING_MPMC:
+    return dts_ring_pop(test->ring, item);
+  case RING_MPSC:
+    return dts_ring_pop_single(test->ring, item);
+  default:
+    return dts_spsc_ring_pop(test->spsc, item);
+  }
+}
+
+static void *producer(void *arg) {
+  ring_thread *self = arg;
+  ring_test   *test = self->test;
+  for (uint64_t seq = 0; seq < ITEMS && !test->failed; ++seq) {
+    // Full, the consumers may need the processor to make room
+    while (!ring_push(test, ITEM(self->id, seq)) && !test->failed) {
+      sched_yield();
+    }
+  }
+  return 0;
+}
+
+static void *consumer(void *arg) {
+  ring_thread *self  = arg;
+  ring_test   *test  = self->test;
+  size_t       total = test->producers * ITEMS;
+
+  // Next sequence number at least expected from every producer
+  uint64_t next[MAX_THREADS] = {0};
+
+  while (__atomic_load_n(&test->taken, __ATOMIC_RELAXED) < total &&
+         !test->failed) {
+    uint64_t item;
+    if (!ring_pop(test, &item)) {
+      sched_yield();
+      continue;
+    }
+
+    size_t   prod = ITEM_PRODUCER(item);
+    uint64_t seq  = ITEM_SEQ(item);
+    if (prod >= test->producers || seq >= ITEMS || seq < next[prod]) {
+      printf("  consumer %zu: %zu:%lu out of order\n", self->id, prod, seq);
+      test->failed = true;
+      break;
+    }
+    next[prod] = seq + 1;
+
+    __atomic_add_fetch(&test->seen[prod * ITEMS + seq], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&test->taken, 1, __ATOMIC_RELAXED);
+  }
+  return 0;
+}
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool run(char const *name, ring_kind kind, size_t prods, size_t cons) {
+  ring_test test = {.kind = kind, .producers = prods, .consumers = cons};
+  if (kind == RING_SPSC) {
+    test.spsc = dts_spsc_ring_create(sizeof(uint64_t), RING_CAP);
+  } else {
+    test.ring = dts_ring_create(sizeof(uint64_t), RING_CAP);
+  }
+  test.seen = calloc(prods * ITEMS, 1);
+  if ((!test.ring && !test.spsc) || !test.seen) {
+    printf("%s: out of memory\n", name);
+    return false;
+  }
+
+  ring_thread threads[MAX_THREADS * 2];
+  double      start = now();
+
+  for (size_t i = 0; i < cons; ++i) {
+    threads[i] = (ring_thread){.test = &test, .id = i};
+    pthread_create(&threads[i].thread, 0, consumer, threads + i);
+  }
+  for (size_t i = 0; i < prods; ++i) {
+    ring_thread *thread = threads + cons + i;
+    *thread             = (ring_thread){.test = &test, .id = i};
+    pthread_create(&thread->thread, 0, producer, thread);
+  }
+  for (size_t i = 0; i < prods + cons; ++i) {
+    pthread_join(threads[i].thread, 0);
+  }
+
+  double elapsed = now() - start;
+
+  for (size_t i = 0; !test.failed && i < prods * ITEMS; ++i) {
+    if (test.seen[i] != 1) {
+      printf(
+          "  %zu:%zu seen %u times\n", i / ITEMS, i % ITEMS, test.seen[i]
+      );
+      test.failed = true;
+    }
+  }
+
+  printf(
+      "%s %zuP/%zuC: %s, %.1f M elements/s\n",
+      name,
+      prods,
+      cons,
+      test.failed ? "FAILED" : "ok",
+      prods * ITEMS / elapsed / 1e6
+  );
+
+  free(test.seen);
+  if (test.ring) {
+    dts_ring_destroy(test.ring);
+  }
+  if (test.spsc) {
+    dts_spsc_ring_destroy(test.spsc);
+  }
+  return !test.failed;
+}
+
+int main() {
+  bool ok = true;
+  setvbuf(stdout, 0, _IONBF, 0);
+
+  ok &= run("spsc", RING_SPSC, 1, 1);
+  ok &= run("mpsc", RING_MPSC, 1, 1);
+  ok &= run("mpsc", RING_MPSC, 4, 1);
+  ok &= run("mpmc", RING_MPMC, 1, 1);
+  ok &= run("mpmc", RING_MPMC, 4, 4);
+  ok &= run("mpmc", RING_MPMC, 8, 2);
+
+  return ok ? 0 : 1;
+}
@@ -28,6 +28,36 @@ bool isspace(char c) {
   return c == ' ';
 }
 
+// Writes n in decimal, buf holds at least 21 characters
+char *utoa(uint64_t n, char *buf) {
+  char *cursor = buf + 20;
+  *cursor      = 0;
+  do {
+    *--cursor = '0' + n % 10;
+    n /= 10;
+  } while (n);
+  return cursor;
+}
+
+#define SYSCALLBENCH_ROUNDS (100000)
+
+// Measures the round trip of a system call that does nothing
+void syscallbench() {
+  char buf[21];
+
+  uint64_t start = __builtin_ia32_rdtsc();
+  for (size_t i = 0; i < SYSCALLBENCH_ROUNDS; ++i) {
+    syscall_nop();
+  }
+  uint64_t cycles = __builtin_ia32_rdtsc() - start;
+
+  syscall_print("Null system call: ");
+  syscall_print(utoa(cycles / SYSCALLBENCH_ROUNDS, buf));
+  syscall_print(" cycles (");
+  syscall_print(utoa(SYSCALLBENCH_ROUNDS, buf));
+  syscall_print(" calls)\n");
+}
+
 void readline(char *buf, size_t len) {
   char rdbuf[1] = {0};
   memset(buf, 0, len);
@@ -72,6 +102,16 @@ int main() {
       syscall_clear();
     } else if (!strcmp(cmd, "version")) {
       syscall_print("HeliumOS v0.1\n");
+    } else if (!strcmp(cmd, "lockstat")) {
+      syscall_lockstat(false);
+    } else if (!strcmp(cmd, "lockstat-reset")) {
+      syscall_lockstat(true);
+    } else if (!strcmp(cmd, "ctxbench")) {
+      syscall_ctxbench();
+    } else if (!strcmp(cmd, "syscallbench")) {
+      syscallbench();
+    } else if (!strcmp(cmd, "mallocbench")) {
+      syscall_mallocbench();
     } else if (!strcmp(cmd, "exit")) {
       syscall_exit(0);
     } else {
@@ -1,6 +1,7 @@
 #ifndef RT_SYSCALL_H
 #define RT_SYSCALL_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -11,6 +12,10 @@
 #define SYSCALL_CLEAR (0x14)
 #define SYSCALL_KCFG (0x15)
 #define SYSCALL_KCBG (0x16)
+#define SYSCALL_LOCKSTAT (0x17)
+#define SYSCALL_CTXBENCH (0x18)
+#define SYSCALL_NOP (0x19)
+#define SYSCALL_MALLOCBENCH (0x1A)
 
 uint64_t dosyscall(uint64_t syscall, ...);
 
@@ -21,6 +26,10 @@ size_t syscall_gets(char *buf, size_t len);
 void syscall_clear();
 void syscall_kcfg(uint16_t r, uint16_t g, uint16_t b);
 void syscall_kcbg(uint16_t r, uint16_t g, uint16_t b);
+void syscall_lockstat(bool reset);
+void syscall_ctxbench();
+void syscall_nop();
+void syscall_mallocbench();
 
 
 #endif
\ No newline at end of file
@@ -25,3 +25,15 @@ void syscall_kcfg(uint16_t r, uint16_t g, uint16_t b) {
 void syscall_kcbg(uint16_t r, uint16_t g, uint16_t b) {
   dosyscall(SYSCALL_KCBG, r, g, b);
 }
+void syscall_lockstat(bool reset) {
+  dosyscall(SYSCALL_LOCKSTAT, reset);
+}
+void syscall_ctxbench() {
+  dosyscall(SYSCALL_CTXBENCH);
+}
+void syscall_nop() {
+  dosyscall(SYSCALL_NOP);
+}
+void syscall_mallocbench() {
+  dosyscall(SYSCALL_MALLOCBENCH);
+}